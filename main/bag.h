@@ -2,13 +2,24 @@
 #define BAG_H
 
 #include <algorithm>
-#include <deque>
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
 
 #include "boardstate.h"
+#include "little_endian.h"
+#include "random.h"
 
+// The bag of tiles not yet drawn.  Tiles are drawn at random (with the bag's
+// own random number generator), so there is no need to ever shuffle the bag:
+// drawing and returning a tile are both O(1).
 class Bag {
  public:
-  Bag() {
+  static const int kNumTiles = 108;
+
+  explicit Bag(uint64_t seed) : Bag(Random(seed)) {}
+
+  explicit Bag(Random random) : random_(random), size_(0) {
     std::vector<Tile::Color> colors =
       {Tile::red, Tile::cyan, Tile::yellow,
        Tile::green, Tile::blue, Tile::violet};
@@ -18,29 +29,47 @@ class Bag {
     for (auto c = colors.begin(); c != colors.end(); c++) {
       for (auto s = shapes.begin(); s != shapes.end(); s++) {
 	for (int i = 0; i < 3; i++) {
-	  tiles_.push_back(Tile(*c, *s));
+	  tiles_[size_++] = Tile(*c, *s).code();
 	}
       }
     }
   }
 
-  void shuffle() {
-    std::random_shuffle(tiles_.begin(), tiles_.end());
+  // A bag holding just the given tiles, for playing out guesses at what the
+  // bag might hold.
+  Bag(Random random, const std::vector<Tile>& tiles) :
+    random_(random), size_(0) {
+    assert(tiles.size() <= size_t(kNumTiles));
+    for (auto t = tiles.begin(); t != tiles.end(); t++) {
+      tiles_[size_++] = t->code();
+    }
   }
 
   size_t tiles_left() const {
-    return tiles_.size();
+    return size_;
   }
 
+  // The tiles left, in no particular order.
+  std::vector<Tile> getTiles() const {
+    std::vector<Tile> tiles;
+    for (int i = 0; i < size_; i++) {
+      tiles.push_back(Tile::fromCode(tiles_[i]));
+    }
+    return tiles;
+  }
+
+  // Draws a random tile: swap it with the last tile, then drop the last tile.
   Tile pick_tile() {
-    Tile tile = tiles_.front();
-    tiles_.pop_front();
-    return tile;
+    assert(size_ > 0);
+    int i = random_.uniform(size_);
+    uint8_t code = tiles_[i];
+    tiles_[i] = tiles_[--size_];
+    return Tile::fromCode(code);
   }
 
   void return_tile(Tile tile) {
-    tiles_.push_front(tile);
-    shuffle();
+    assert(size_ < kNumTiles);
+    tiles_[size_++] = tile.code();
   }
 
   void return_tiles(std::vector<Tile> tiles) {
@@ -48,8 +77,41 @@ class Bag {
 		  [this](Tile t){return_tile(t);});
   }
 
+  // A bag's snapshot (see snapshot.h) is the number of tiles left, its random
+  // number generator, and its tiles' codes, so a restored bag draws the same
+  // tiles as the original would have.
+  static const int kSnapshotSize = 4 + Random::kSnapshotSize + kNumTiles;
+
+  void saveSnapshot(uint8_t* out) const {
+    storeLE(out, size_, 4);
+    random_.saveSnapshot(out + 4);
+    std::copy(tiles_, tiles_ + kNumTiles, out + 4 + Random::kSnapshotSize);
+  }
+
+  // Returns false (leaving the bag unchanged) if the snapshot holds too many
+  // tiles or a tile that doesn't exist.
+  bool loadSnapshot(const uint8_t* in) {
+    uint32_t size = loadLE(in, 4);
+    const uint8_t* tiles = in + 4 + Random::kSnapshotSize;
+    Random random = random_;
+    if (size > uint32_t(kNumTiles) || !random.loadSnapshot(in + 4)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < size; i++) {
+      if (tiles[i] >= Tile::kNumCodes) {
+	return false;
+      }
+    }
+    random_ = random;
+    size_ = size;
+    std::copy(tiles, tiles + kNumTiles, tiles_);
+    return true;
+  }
+
  private:
-  std::deque<Tile> tiles_;
+  Random random_;
+  uint8_t tiles_[kNumTiles];  // Tile codes
+  int size_;
 };
 
 #endif // BAG_H
@@ -1,10 +1,19 @@
 #ifndef BOARDSTATE_H
 #define BOARDSTATE_H
 
+#include <algorithm>
 #include <assert.h>
-#include <variant>
-#include <deque>
+#include <stdint.h>
+#include <string.h>
+#include <iomanip>
 #include <iostream>
+#include <vector>
+
+#include "grid_check.h"
+#include "little_endian.h"
+#include "stats.h"
+#include "tileset.h"
+#include "zobrist.h"
 
 using std::cout;
 using std::endl;
@@ -14,81 +23,140 @@ class Tile {
   enum Color { red, cyan, yellow, green, blue, violet };
   enum Shape { circle, x, diamond, square, starburst, cross };
 
-  Tile(Color color, Shape shape) : color_(color), shape_(shape) {}
-  Color color() const { return color_; }
-  Shape shape() const { return shape_; }
+  Tile(Color color, Shape shape) : code_(color * 6 + shape) {}
+  Color color() const { return static_cast<Color>(code_ / 6); }
+  Shape shape() const { return static_cast<Shape>(code_ % 6); }
+
+  // Each of the 36 distinct tiles has a code in [0, 36).  A tile is stored as
+  // just its code.
+  static const int kNumCodes = 36;
+  int code() const { return code_; }
+  static Tile fromCode(int code) {
+    assert(code >= 0 && code < kNumCodes);
+    return Tile(code);
+  }
 
   bool operator==(const Tile& t) const {
-    return (color_ == t.color_ && shape_ == t.shape_);
+    return code_ == t.code_;
   }
 
-  void print() const {
+  void print(std::ostream& out = cout) const {
     switch(color()) {
     case red:
-      cout << "\u001b[31m";
+      out << "\u001b[31m";
       break;
     case cyan:
-      cout << "\u001b[36m";
+      out << "\u001b[36m";
       break;
     case yellow:
-      cout << "\u001b[33m";
+      out << "\u001b[33m";
       break;
     case green:
-      cout << "\u001b[32m";
+      out << "\u001b[32m";
       break;
     case blue:
-      cout << "\u001b[34m";
+      out << "\u001b[34m";
       break;
     case violet:
-      cout << "\u001b[35m";
+      out << "\u001b[35m";
       break;
     }
     switch(shape()) {
     case circle:
-      cout << "● ";
+      out << "● ";
       break;
     case x:
-      cout << "✖ ";
+      out << "✖ ";
       break;
     case diamond:
-      cout << "◆ ";
+      out << "◆ ";
       break;
     case square:
-      cout << "■ ";
+      out << "■ ";
       break;
     case starburst:
-      cout << "🟏 ";
+      out << "🟏 ";
       break;
     case cross:
-      cout << "🞧 ";
+      out << "🞧 ";
       break;
     }
 	
-    cout << "\u001b[0m"; // Reset color
+    out << "\u001b[0m"; // Reset color
   }
 
  private:
-  Color color_;
-  Shape shape_;
-};
+  explicit Tile(int code) : code_(code) {}
 
-class NoTile {};
+  uint8_t code_;
+};
 
 // A particular board state.  The board is a 2D grid, indexed by arbitrary x&y
-// coordinates.  Each square contains either a Tile or NoTile.
+// coordinates.  Each square is one byte: 0 if empty, otherwise the code of the
+// Tile on it plus one.
+//
+// The grid has a fixed capacity so that copying a board is a single memcpy.
+// The first tile placed goes in the middle of the grid, and if play drifts
+// towards an edge the tiles are moved back to the middle.  Words are at most 6
+// tiles long, so the 108 tiles of a legal game can't stretch across more than
+// about 90 squares in either direction: any legal game fits.
+//
+// Alongside each tile the board keeps the lengths of the horizontal and
+// vertical words through it, so that scoring a move doesn't need to scan the
+// board.  It also keeps a Zobrist key for the whole board (see zobrist.h), so
+// that positions can be compared or looked up without scanning it either.
 class BoardState {
  public:
+  static const int kSize = 128;
+
+  // Word lengths are stored in 4 bits, so are capped at this.  Only invalid
+  // words can be that long.
+  static const int kMaxWordLength = 15;
+
  BoardState() :
-  minx_(0), maxx_(0), miny_(0), maxy_(0) {}
+  minx_(0), maxx_(0), miny_(0), maxy_(0), originx_(0), originy_(0), key_(0),
+  cells_(), word_lengths_() {}
 
   int minX() const { return minx_; }
   int maxX() const { return maxx_; }
   int minY() const { return miny_; }
   int maxY() const { return maxy_; }
 
+  // The XOR of squareKey() for every tile on the board.  Boards with the same
+  // tiles on the same squares have the same key.
+  uint64_t key() const { return key_; }
+
+  // Returns true if the grid has room for a tile at (x,y).  Only an illegal
+  // move (one not connected to the tiles already played) can fail to fit.
+  bool canHold(int x, int y) const {
+    if (minx_ == maxx_) {
+      return true;
+    }
+    // Leave an empty square on every side of the board (see inGrid()).
+    return (std::max(maxx_, x + 1) - std::min(minx_, x) <= kSize - 2 &&
+	    std::max(maxy_, y + 1) - std::min(miny_, y) <= kSize - 2);
+  }
+
   void insertTile(Tile tile, int x, int y) {
     resizeBoardToInclude(x, y);
-    board_[y-miny_][x - minx_] = tile;
+    cells_[index(x, y)] = tile.code() + 1;
+    key_ ^= squareKey(x, y, tile.code());
+    updateWordLengths(x, y, 1, 0);
+    updateWordLengths(x, y, 0, 1);
+  }
+
+  // Takes the tile at (x,y) off the board, shrinking the board's extents if
+  // it was on the edge.  Used to undo insertTile() when searching for moves.
+  void removeTile(int x, int y) {
+    assert(!isEmpty(x, y));
+    key_ ^= squareKey(x, y, cells_[index(x, y)] - 1);
+    cells_[index(x, y)] = 0;
+    word_lengths_[index(x, y)] = 0;
+    updateWordLengths(x - 1, y, 1, 0);
+    updateWordLengths(x + 1, y, 1, 0);
+    updateWordLengths(x, y - 1, 0, 1);
+    updateWordLengths(x, y + 1, 0, 1);
+    shrinkBoardToFit();
   }
 
   bool isEmpty(int x, int y) const {
@@ -98,7 +166,7 @@ class BoardState {
 	y >= maxy_) {
       return true;
     }
-    return std::holds_alternative<NoTile>(board_[y-miny_][x-minx_]);
+    return cells_[index(x, y)] == 0;
   }
 
   bool isAdjacent(int x, int y) const {
@@ -109,149 +177,394 @@ class BoardState {
        !isEmpty(x, y+1));
   }
 
-  const Tile& getTile(int x, int y) const {
+  Tile getTile(int x, int y) const {
     assert(!isEmpty(x, y));
-    return std::get<Tile>(board_[y-miny_][x-minx_]);
+    return Tile::fromCode(cells_[index(x, y)] - 1);
   }
 
+  // Copies what is on the squares in columns [minx, maxx) of rows [miny, maxy)
+  // to out, row by row: 0 for an empty square, otherwise the code of the tile
+  // plus one.  For comparing boards.
+  void getSquares(int minx, int maxx, int miny, int maxy, uint8_t* out) const {
+    int width = maxx - minx;
+    std::fill(out, out + width * (maxy - miny), 0);
+    // Only the part of the rectangle inside the board's extents can have tiles
+    // on it.
+    int x0 = std::max(minx, minx_);
+    int x1 = std::min(maxx, maxx_);
+    for (int y = std::max(miny, miny_); y < std::min(maxy, maxy_) && x0 < x1;
+	 y++) {
+      std::copy(cells_ + index(x0, y), cells_ + index(x1, y),
+		out + (y - miny) * width + (x0 - minx));
+    }
+  }
+
+  // Returns the length of the horizontal (or vertical) word through the tile at
+  // (x,y), in constant time.
+  int wordLength(int x, int y, bool horiz) const {
+    assert(!isEmpty(x, y));
+    uint8_t lengths = word_lengths_[index(x, y)];
+    return horiz ? (lengths & 0xf) : (lengths >> 4);
+  }
+
+  // Returns true if the words through (x,y) would still be valid after placing
+  // tile on that (empty) square.  Only the horizontal and vertical words
+  // through (x,y) can change, so the rest of the board isn't examined.
+  bool canPlace(Tile tile, int x, int y) const {
+    assert(isEmpty(x, y));
+    return validWordThrough(tile, x, y, 1, 0) &&
+      validWordThrough(tile, x, y, 0, 1);
+  }
+
+  // Returns true if the horizontal and vertical words through the tile already
+  // placed at (x,y) are valid.  If the board was valid before that tile was
+  // placed, this is equivalent to (but much cheaper than) isValidBoard().
+  bool isValidAfterPlacing(int x, int y) const {
+    Tile tile = getTile(x, y);
+    return validWordThrough(tile, x, y, 1, 0) &&
+      validWordThrough(tile, x, y, 0, 1);
+  }
+
+  // Returns the set of tiles which could be placed on the empty square (x,y)
+  // without making the board invalid.
+  TileSet legalTiles(int x, int y) const {
+    assert(isEmpty(x, y));
+    return compatibleTiles(x, y, 1, 0) & compatibleTiles(x, y, 0, 1);
+  }
+
+  // Checks every word on the board.  This is expensive, use canPlace() or
+  // isValidAfterPlacing() when only a few tiles have changed.
   bool isValidBoard() const {
+    COUNT_SEARCH_STAT(validations);
     // Each sequence of tiles separated by an empty space is a "word".  Tiles in
     // a word must all have the same color or the same shape.  A tile can't
-    // repeat itself in a word.
-    for (int y = miny_; y < maxy_; y++) {
-      std::deque<Tile> word;
-      for (int x = minx_; x < maxx_; x++) {
-	if (!isEmpty(x, y)) {
-	  word.push_back(getTile(x,y));
-	} else {
-	  if (word.size() > 0 && !validWord(word)) {
-	    return false;
-	  }
-	  word.clear();
-	}
-      }
-      if (word.size() > 0 && !validWord(word)) {
-	return false;
-      }
+    // repeat itself in a word.  See grid_check.h.
+    static_assert(kSize == kGridSize, "grid_check.h assumes the grid's size");
+    return isValidGrid(cells_, miny_ + originy_, maxy_ + originy_,
+		       minx_ + originx_, maxx_ + originx_);
+  }
+
+  // A board's snapshot (see snapshot.h) is its extents, origin and key, then
+  // its grid and word lengths exactly as they are held in memory, so loading
+  // one copies two blocks of memory rather than inserting a tile at a time.
+  static const int kSnapshotSize = 32 + 2 * kSize * kSize;
+
+  void saveSnapshot(uint8_t* out) const {
+    int fields[6] = {minx_, maxx_, miny_, maxy_, originx_, originy_};
+    for (int i = 0; i < 6; i++) {
+      storeLE(out + 4 * i, uint32_t(fields[i]), 4);
     }
+    storeLE(out + 24, key_, 8);
+    memcpy(out + 32, cells_, sizeof(cells_));
+    memcpy(out + 32 + sizeof(cells_), word_lengths_, sizeof(word_lengths_));
+  }
 
-    for (int x = minx_; x < maxx_; x++) {
-      std::deque<Tile> word;
-      for (int y = miny_; y < maxy_; y++) {
-	if (!isEmpty(x, y)) {
-	  word.push_back(getTile(x,y));
-	} else {
-	  if (word.size() > 0 && !validWord(word)) {
-	    return false;
-	  }
-	  word.clear();
-	}
-      }
-      if (word.size() > 0 && !validWord(word)) {
-	return false;
-      }
+  // Replaces the board with the snapshot's.  Returns false (leaving the board
+  // unchanged) if the snapshot's extents don't fit the grid.  Otherwise the
+  // grid and word lengths are copied as they are, unless verify is set: then
+  // the snapshot is also rejected if it has a tile that doesn't exist or lies
+  // outside its extents, it has an invalid line, or its key or word lengths
+  // don't match its tiles.  Only snapshots which may not have been written by
+  // saveSnapshot() need verifying (snapshot.h checksums the rest).
+  bool loadSnapshot(const uint8_t* in, bool verify) {
+    int fields[6];
+    for (int i = 0; i < 6; i++) {
+      fields[i] = int32_t(loadLE(in + 4 * i, 4));
     }
+    int minx = fields[0], maxx = fields[1], miny = fields[2], maxy = fields[3];
+    int originx = fields[4], originy = fields[5];
+    bool empty = (minx == maxx);
+    if (minx > maxx || miny > maxy ||
+	(!empty && (minx + originx < 1 || maxx + originx > kSize - 1 ||
+		    miny + originy < 1 || maxy + originy > kSize - 1))) {
+      return false;
+    }
+    const uint8_t* cells = in + 32;
+    const uint8_t* lengths = cells + sizeof(cells_);
+    uint64_t key = loadLE(in + 24, 8);
+    if (verify && !verifySnapshot(cells, lengths, key, empty,
+				  minx + originx, maxx + originx,
+				  miny + originy, maxy + originy,
+				  originx, originy)) {
+      return false;
+    }
+
+    minx_ = minx;
+    maxx_ = maxx;
+    miny_ = miny;
+    maxy_ = maxy;
+    originx_ = originx;
+    originy_ = originy;
+    key_ = key;
+    memcpy(cells_, cells, sizeof(cells_));
+    memcpy(word_lengths_, lengths, sizeof(word_lengths_));
     return true;
   }
 
-  void print() const {
-    cout << "    ";
+  void print(std::ostream& out = cout) const {
+    out << "    ";
     for (int x = minX(); x < maxX(); x++) {
-      cout << " " << std::setfill(' ') << std::setw(3) << x;
+      out << " " << std::setfill(' ') << std::setw(3) << x;
     }
-    cout << endl;
+    out << endl;
 
     for (int y = minY(); y < maxY(); y++) {
-      cout << std::setfill(' ') << std::setw(3) << y << ":";
+      out << std::setfill(' ') << std::setw(3) << y << ":";
 
       for (int x = minX(); x < maxX(); x++) {
-	cout << "  ";
+	out << "  ";
 	if (isEmpty(x, y)) {
-	  cout << "--";
+	  out << "--";
 
 	} else {
 	  Tile tile = getTile(x, y);
-	  tile.print();
+	  tile.print(out);
 	}
       }
-      cout << endl;
+      out << endl;
     }
   }
 
-  // Currently no way of deleting a Tile.  Do we need that?
-
  private:
+  int index(int x, int y) const {
+    return (y + originy_) * kSize + (x + originx_);
+  }
+
+  // Returns true if (x,y) is inside the grid, and not on its outermost
+  // squares.  Those are always left empty, so a walk along a word always stops
+  // inside the grid.
+  bool inGrid(int x, int y) const {
+    return (x + originx_ >= 1 && x + originx_ < kSize - 1 &&
+	    y + originy_ >= 1 && y + originy_ < kSize - 1);
+  }
+
   void resizeBoardToInclude(int x, int y) {
-    if (board_.size() == 0) {
-      // First tile
+    if (minx_ == maxx_) {
+      // First tile: centre the grid on it.
+      originx_ = kSize / 2 - x;
+      originy_ = kSize / 2 - y;
       minx_ = x;
       maxx_ = x;
       miny_ = y;
       maxy_ = y;
     }
+    assert(canHold(x, y));
 
-    while (y >= maxy_) {
-      board_.push_back(std::deque<std::variant<NoTile, Tile>>());
-      board_[maxy_-miny_].resize(maxx_-minx_, NoTile());
-      maxy_++;
+    if (!inGrid(x, y)) {
+      recentre(std::min(minx_, x), std::max(maxx_, x + 1),
+	       std::min(miny_, y), std::max(maxy_, y + 1));
     }
-    while (y < miny_) {
-      board_.push_front(std::deque<std::variant<NoTile, Tile>>());
-      board_[0].resize(maxx_-minx_, NoTile());
-      miny_--;
+
+    if (x < minx_) {
+      minx_ = x;
     }
-    while (x >= maxx_) {
-      for (int iy = miny_; iy < maxy_; iy++) {
-	board_[iy-miny_].push_back(NoTile());
-      }
-      maxx_++;
+    if (x >= maxx_) {
+      maxx_ = x + 1;
     }
-    while (x < minx_) {
-      for (int iy = miny_; iy < maxy_; iy++) {
-	board_[iy-miny_].push_front(NoTile());
+    if (y < miny_) {
+      miny_ = y;
+    }
+    if (y >= maxy_) {
+      maxy_ = y + 1;
+    }
+  }
+
+  // Moves every tile so that the given extents are centred in the grid.  This
+  // only happens when a game drifts a long way from its first tile.
+  void recentre(int minx, int maxx, int miny, int maxy) {
+    struct Square {
+      int x, y;
+      uint8_t cell, word_lengths;
+    };
+    std::vector<Square> squares;
+    for (int y = miny_; y < maxy_; y++) {
+      for (int x = minx_; x < maxx_; x++) {
+	if (!isEmpty(x, y)) {
+	  squares.push_back(Square{x, y, cells_[index(x, y)],
+				   word_lengths_[index(x, y)]});
+	  cells_[index(x, y)] = 0;
+	  word_lengths_[index(x, y)] = 0;
+	}
       }
-      minx_--;
+    }
+    originx_ = (kSize - (maxx - minx)) / 2 - minx;
+    originy_ = (kSize - (maxy - miny)) / 2 - miny;
+    for (auto s = squares.begin(); s != squares.end(); s++) {
+      cells_[index(s->x, s->y)] = s->cell;
+      word_lengths_[index(s->x, s->y)] = s->word_lengths;
     }
   }
 
-  static bool validWord(const std::deque<Tile>& word) {
-    bool const_color = true;
-    bool const_shape = true;
-    Tile prev_tile = *word.begin();
-    for (auto i = word.begin(); i != word.end(); i++) {
-      const_color = const_color &&
-	(prev_tile.color() == i->color());
-      const_shape = const_shape &&
-	(prev_tile.shape() == i->shape());
-      prev_tile = *i;
-    }
-    if (const_color) {
-      std::vector<bool> shape_found =
-	{ false, false, false, false, false, false };
-      for (auto i = word.begin(); i != word.end(); i++) {
-	if (shape_found[i->shape()]) {
+  // Checks a snapshot's grid and word lengths for loadSnapshot(), given its
+  // key, whether it's empty, and its extents [gx0, gx1) and [gy0, gy1) and
+  // origin on the grid.  Only squares within the extents can hold tiles or
+  // word lengths, so the rest of the grid is just checked to be empty before
+  // the lines through each tile are followed.
+  static bool verifySnapshot(const uint8_t* cells, const uint8_t* lengths,
+			     uint64_t key, bool empty,
+			     int gx0, int gx1, int gy0, int gy1,
+			     int originx, int originy) {
+    for (int gy = 0; gy < kSize; gy++) {
+      for (int gx = 0; gx < kSize; gx++) {
+	int i = gy * kSize + gx;
+	bool inside = (!empty && gx >= gx0 && gx < gx1 &&
+		       gy >= gy0 && gy < gy1);
+	if (cells[i] > Tile::kNumCodes ||
+	    (!inside && (cells[i] != 0 || lengths[i] != 0))) {
 	  return false;
 	}
-	shape_found[i->shape()] = true;
       }
     }
-    if (const_shape) {
-      std::vector<bool> color_found =
-	{ false, false, false, false, false, false };
-      for (auto i = word.begin(); i != word.end(); i++) {
-	if (color_found[i->color()]) {
+    if (empty) {
+      return key == 0;
+    }
+    if (!isValidGrid(cells, gy0, gy1, gx0, gx1)) {
+      return false;
+    }
+    uint64_t tiles_key = 0;
+    for (int gy = gy0; gy < gy1; gy++) {
+      for (int gx = gx0; gx < gx1; gx++) {
+	int i = gy * kSize + gx;
+	if (cells[i] == 0) {
+	  if (lengths[i] != 0) {
+	    return false;
+	  }
+	  continue;
+	}
+	tiles_key ^= squareKey(gx - originx, gy - originy, cells[i] - 1);
+	if (lengths[i] != (gridWordLength(cells, i, 1) |
+			   gridWordLength(cells, i, kSize) << 4)) {
 	  return false;
 	}
-	color_found[i->color()] = true;
       }
     }
-    
-    return (const_color || const_shape);
+    return tiles_key == key;
+  }
+
+  // The length of the word through square i of grid along step (1 for its row,
+  // kSize for its column), as updateWordLengths() stores it.  Square i must
+  // hold a tile, and the word mustn't reach the edge of the grid.
+  static int gridWordLength(const uint8_t* grid, int i, int step) {
+    int start = i;
+    while (grid[start - step] != 0) {
+      start -= step;
+    }
+    int length = 0;
+    for (int j = start; grid[j] != 0; j += step) {
+      length++;
+    }
+    if (length > kMaxWordLength) {
+      length = kMaxWordLength;
+    }
+    return length;
+  }
+
+  // Recomputes the stored length of the word in direction (dx,dy) through
+  // (x,y) for every tile in that word.  Does nothing if (x,y) is empty.
+  void updateWordLengths(int x, int y, int dx, int dy) {
+    if (isEmpty(x, y)) {
+      return;
+    }
+    // Words never reach the edge of the grid, so we can walk along the grid
+    // directly rather than through isEmpty().
+    int step = dy * kSize + dx;
+    int start = index(x, y);
+    while (cells_[start - step] != 0) {
+      start -= step;
+    }
+    int length = gridWordLength(cells_, start, step);
+    int shift = (dx != 0) ? 0 : 4;
+    for (int i = start; cells_[i] != 0; i += step) {
+      word_lengths_[i] = (word_lengths_[i] & ~(0xf << shift)) |
+	(length << shift);
+    }
+  }
+
+  bool rowIsEmpty(int y) const {
+    for (int x = minx_; x < maxx_; x++) {
+      if (!isEmpty(x, y)) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  bool columnIsEmpty(int x) const {
+    for (int y = miny_; y < maxy_; y++) {
+      if (!isEmpty(x, y)) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  void shrinkBoardToFit() {
+    while (miny_ < maxy_ && rowIsEmpty(miny_)) {
+      miny_++;
+    }
+    while (miny_ < maxy_ && rowIsEmpty(maxy_ - 1)) {
+      maxy_--;
+    }
+    while (minx_ < maxx_ && columnIsEmpty(minx_)) {
+      minx_++;
+    }
+    while (minx_ < maxx_ && columnIsEmpty(maxx_ - 1)) {
+      maxx_--;
+    }
+    if (miny_ == maxy_ || minx_ == maxx_) {
+      // The board is empty again.
+      minx_ = maxx_ = miny_ = maxy_ = 0;
+    }
+  }
+
+  // Returns the set of tiles which would form a valid word with the tiles on
+  // either side of the empty square (x,y) in direction (dx,dy).
+  TileSet compatibleTiles(int x, int y, int dx, int dy) const {
+    // Once we're on a tile we can walk along the grid directly rather than
+    // through isEmpty(), as words never reach the edge of the grid.
+    int step = dy * kSize + dx;
+    WordTiles word;
+    if (!isEmpty(x - dx, y - dy)) {
+      for (int i = index(x - dx, y - dy); cells_[i] != 0; i -= step) {
+	word.add(cells_[i] - 1);
+      }
+    }
+    if (!isEmpty(x + dx, y + dy)) {
+      for (int i = index(x + dx, y + dy); cells_[i] != 0; i += step) {
+	word.add(cells_[i] - 1);
+      }
+    }
+    return word.compatible();
+  }
+
+  // Checks the word running through (x,y) in direction (dx,dy), treating (x,y)
+  // as if it held tile (whatever is actually there).
+  bool validWordThrough(Tile tile, int x, int y, int dx, int dy) const {
+    WordTiles word;
+    word.add(tile.code());
+    for (int ix = x - dx, iy = y - dy; !isEmpty(ix, iy); ix -= dx, iy -= dy) {
+      word.add(getTile(ix, iy).code());
+    }
+    for (int ix = x + dx, iy = y + dy; !isEmpty(ix, iy); ix += dx, iy += dy) {
+      word.add(getTile(ix, iy).code());
+    }
+    return word.isValid();
   }
 
   int minx_, maxx_, miny_, maxy_;
 
-  std::deque<std::deque<std::variant<NoTile, Tile>>> board_;
+  // Offset from board coordinates to grid coordinates.
+  int originx_, originy_;
+
+  uint64_t key_;
+
+  uint8_t cells_[kSize * kSize];
+
+  // For each tile, the length of the horizontal word through it in the low 4
+  // bits and the vertical word in the high 4 bits.
+  uint8_t word_lengths_[kSize * kSize];
+
+  BoardCopyCounter copies_;
 };
 
 #endif // BOARDSTATE_H
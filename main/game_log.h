@@ -0,0 +1,297 @@
+#ifndef GAME_LOG_H
+#define GAME_LOG_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "boardstate.h"
+#include "little_endian.h"
+#include "mapped_file.h"
+#include "rack.h"
+#include "search.h"
+
+// A compact binary record of complete games, appended to a log file one game
+// at a time and read back by memory-mapping the file, so that millions of
+// games can be replayed without parsing text.
+//
+// A log is just its games' records, one after another.  Numbers are
+// little-endian (see little_endian.h).  Each record is:
+//
+//   0   4 bytes   kGameMagic, to catch reading from the wrong place
+//   4   4 bytes   size of the whole record, in bytes
+//   8   8 bytes   the seed the game's bag was made from
+//   16  2 bytes   number of turns
+//   18  2 x 2     final score of each player (signed)
+//   22  1 byte    kGameVersion
+//   23  1 byte    0
+//   24  2 x 6     each player's starting rack, as tile codes, 0xff for none
+//   36            the turns
+//
+// and each turn is:
+//
+//   0   1 byte    player, plus 2 if the turn was an exchange
+//   1   1 byte    tiles placed, or returned to the bag if an exchange
+//   2   1 byte    tiles drawn from the bag afterwards
+//   3   1 byte    points scored (not counting the bonus for going out)
+//   4             each tile placed as x and y (2 bytes each, signed) and its
+//                 code, or each tile returned as its code; then each tile
+//                 drawn as its code
+//
+// Tiles are drawn from the bag at random rather than in some fixed order, so
+// the draws are recorded as they happen: starting racks and draws together
+// are the order the game drew the bag in.  The final scores include the
+// bonus for going out.
+
+const uint32_t kGameMagic = 0x474b5751;  // "QWKG"
+const int kGameVersion = 1;
+const int kGameHeaderSize = 36;
+
+// Builds the record of one game as it is played.
+class GameRecorder {
+ public:
+  // racks are the players' starting racks.
+  GameRecorder(uint64_t seed, const Rack& rack0, const Rack& rack1) :
+    num_turns_(0) {
+    data_.resize(kGameHeaderSize, 0);
+    storeLE(&data_[8], seed, 8);
+    data_[22] = kGameVersion;
+    const Rack* racks[2] = {&rack0, &rack1};
+    for (int player = 0; player < 2; player++) {
+      std::vector<Tile> tiles = racks[player]->getTiles();
+      for (int i = 0; i < Rack::kMaxTiles; i++) {
+	data_[24 + player * Rack::kMaxTiles + i] =
+	  (i < int(tiles.size())) ? tiles[i].code() : 0xff;
+      }
+    }
+  }
+
+  // Records a turn in which player placed move's tiles, taking their rack
+  // from before to after (which includes the tiles drawn).
+  void move(int player, const Move& move, const Rack& before,
+	    const Rack& after) {
+    Rack used = before;
+    size_t start = data_.size();
+    data_.push_back(player);
+    data_.push_back(move.num_tiles);
+    data_.push_back(0);
+    data_.push_back(move.score);
+    for (int i = 0; i < move.num_tiles; i++) {
+      const Placement& p = move.tiles[i];
+      size_t at = data_.size();
+      data_.resize(at + 5);
+      storeLE(&data_[at], uint16_t(p.x), 2);
+      storeLE(&data_[at + 2], uint16_t(p.y), 2);
+      data_[at + 4] = p.tile.code();
+      used.removeTile(p.tile);
+    }
+    data_[start + 2] = putDrawn(used, after);
+    num_turns_++;
+  }
+
+  // Records a turn in which player put returned back in the bag, taking their
+  // rack from before to after.
+  void exchange(int player, const std::vector<Tile>& returned,
+		const Rack& before, const Rack& after) {
+    Rack kept = before;
+    size_t start = data_.size();
+    data_.push_back(player | 2);
+    data_.push_back(returned.size());
+    data_.push_back(0);
+    data_.push_back(0);
+    for (auto t = returned.begin(); t != returned.end(); t++) {
+      data_.push_back(t->code());
+      kept.removeTile(*t);
+    }
+    data_[start + 2] = putDrawn(kept, after);
+    num_turns_++;
+  }
+
+  // Fills in the final scores and returns the finished record.
+  const std::vector<uint8_t>& finish(int score0, int score1) {
+    storeLE(&data_[0], kGameMagic, 4);
+    storeLE(&data_[4], data_.size(), 4);
+    storeLE(&data_[16], num_turns_, 2);
+    storeLE(&data_[18], uint16_t(score0), 2);
+    storeLE(&data_[20], uint16_t(score1), 2);
+    return data_;
+  }
+
+ private:
+  // Appends the tiles on after that aren't on kept.  Returns how many there
+  // were.
+  int putDrawn(const Rack& kept, const Rack& after) {
+    int drawn = 0;
+    std::vector<Tile> tiles = after.getTiles();
+    for (auto t = tiles.begin(); t != tiles.end(); t++) {
+      if (t == tiles.begin() || !(*t == *(t - 1))) {
+	for (int n = kept.count(*t); n < after.count(*t); n++) {
+	  data_.push_back(t->code());
+	  drawn++;
+	}
+      }
+    }
+    return drawn;
+  }
+
+  std::vector<uint8_t> data_;
+  int num_turns_;
+};
+
+// One turn read back from a record.
+struct LoggedTurn {
+  LoggedTurn() :
+    player(0), exchange(false), score(0), num_tiles(0), num_drawn(0) {}
+
+  int player;
+  bool exchange;
+  int score;
+  int num_tiles;
+  Placement tiles[Rack::kMaxTiles];  // Squares are 0,0 for an exchange
+  int num_drawn;
+  uint8_t drawn[Rack::kMaxTiles];    // Tile codes
+};
+
+// A view of one record in a log.  Nothing is copied out of the log until it
+// is asked for.
+class LoggedGame {
+ public:
+  LoggedGame() : data_(nullptr), size_(0) {}
+  LoggedGame(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  size_t size() const { return size_; }
+  uint64_t seed() const { return loadLE(data_ + 8, 8); }
+  int numTurns() const { return loadLE(data_ + 16, 2); }
+  int score(int player) const {
+    return int16_t(loadLE(data_ + 18 + 2 * player, 2));
+  }
+
+  std::vector<Tile> startingRack(int player) const {
+    std::vector<Tile> tiles;
+    for (int i = 0; i < Rack::kMaxTiles; i++) {
+      uint8_t code = data_[24 + player * Rack::kMaxTiles + i];
+      if (code < Tile::kNumCodes) {
+	tiles.push_back(Tile::fromCode(code));
+      }
+    }
+    return tiles;
+  }
+
+  // Reads the turn at *offset (kGameHeaderSize for the first turn) and moves
+  // *offset on to the next.  Returns false if there are no more turns, or the
+  // turn doesn't fit in the record or holds something impossible.
+  bool nextTurn(size_t* offset, LoggedTurn* turn) const {
+    size_t at = *offset;
+    if (at + 4 > size_) {
+      return false;
+    }
+    turn->player = data_[at] & 1;
+    turn->exchange = (data_[at] & 2) != 0;
+    turn->num_tiles = data_[at + 1];
+    turn->num_drawn = data_[at + 2];
+    turn->score = data_[at + 3];
+    at += 4;
+    int tile_size = turn->exchange ? 1 : 5;
+    if (data_[*offset] > 3 || turn->num_tiles > Rack::kMaxTiles ||
+	turn->num_drawn > Rack::kMaxTiles ||
+	at + turn->num_tiles * tile_size + turn->num_drawn > size_) {
+      return false;
+    }
+    for (int i = 0; i < turn->num_tiles; i++) {
+      int x = 0, y = 0;
+      if (!turn->exchange) {
+	x = int16_t(loadLE(data_ + at, 2));
+	y = int16_t(loadLE(data_ + at + 2, 2));
+      }
+      uint8_t code = data_[at + tile_size - 1];
+      if (code >= Tile::kNumCodes) {
+	return false;
+      }
+      turn->tiles[i] = Placement(Tile::fromCode(code), x, y);
+      at += tile_size;
+    }
+    for (int i = 0; i < turn->num_drawn; i++) {
+      turn->drawn[i] = data_[at++];
+      if (turn->drawn[i] >= Tile::kNumCodes) {
+	return false;
+      }
+    }
+    *offset = at;
+    return true;
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+};
+
+// Appends records to a log file, creating it if need be.
+class GameLogWriter {
+ public:
+  explicit GameLogWriter(const std::string& path) :
+    file_(fopen(path.c_str(), "ab")) {}
+
+  ~GameLogWriter() {
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  GameLogWriter(const GameLogWriter&) = delete;
+  GameLogWriter& operator=(const GameLogWriter&) = delete;
+
+  // Returns false if the file couldn't be opened.
+  bool ok() const { return file_ != nullptr; }
+
+  // Appends a finished record, flushing it so that a game is either in the
+  // log whole or (if the process dies while writing) is the last, short,
+  // record.  Returns false on a write error.
+  bool append(const std::vector<uint8_t>& record) {
+    return fwrite(record.data(), 1, record.size(), file_) == record.size() &&
+      fflush(file_) == 0;
+  }
+
+ private:
+  FILE* file_;
+};
+
+// Reads a log file by mapping it into memory, one game at a time.
+class GameLogReader {
+ public:
+  explicit GameLogReader(const std::string& path) : file_(path), offset_(0) {
+    file_.adviseSequential();
+  }
+
+  // Returns false if the file couldn't be opened and mapped.
+  bool ok() const { return file_.ok(); }
+
+  size_t size() const { return file_.size(); }
+
+  // Sets *game to the next record.  Returns false at the end of the log, or
+  // if the rest of the log isn't a whole record (see corrupt()).
+  bool next(LoggedGame* game) {
+    if (offset_ + kGameHeaderSize > file_.size()) {
+      return false;
+    }
+    const uint8_t* p = file_.data() + offset_;
+    size_t size = loadLE(p + 4, 4);
+    if (loadLE(p, 4) != kGameMagic || p[22] != kGameVersion ||
+	size < size_t(kGameHeaderSize) || offset_ + size > file_.size()) {
+      return false;
+    }
+    *game = LoggedGame(p, size);
+    offset_ += size;
+    return true;
+  }
+
+  // Returns true if next() stopped before the end of the log.
+  bool corrupt() const { return offset_ != file_.size(); }
+
+ private:
+  MappedFile file_;
+  size_t offset_;
+};
+
+#endif // GAME_LOG_H
@@ -0,0 +1,260 @@
+#ifndef GRID_CHECK_H
+#define GRID_CHECK_H
+
+#include <stdint.h>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Checks every line on a board at once, for BoardState::isValidBoard().  The
+// grid is a square of kGridSize rows of kGridSize bytes, each 0 for an empty
+// square or a tile's code plus 1, whose outermost rows and columns are always
+// empty.
+//
+// A line is valid when it has no tile twice and its tiles all share a color or
+// all share a shape.  Its tiles then number at most six, and any two of them
+// are different tiles sharing a color or a shape.  That is also enough: if
+// every pair of tiles shares a color or a shape, they can't have two colors
+// and two shapes, since a tile of one color and one shape and a tile of the
+// other color and other shape would share neither.  So the grid is valid if
+// no square starts a line of more than six tiles, and no tile and one of the
+// next five along its row, or above it in its column, with only tiles between,
+// are the same or share neither color nor shape.
+//
+// That is a test of each square on its own, so it's done for a whole vector of
+// squares at once (with AVX2 or SSE2 when the compiler targets them, otherwise
+// a square at a time), row by row.  The vectors work on a packed copy of the
+// grid, in which the color and shape have a byte's bits of their own.  Columns
+// are compared with the rows above, so they need no transposed copy.
+
+const int kGridSize = 128;
+
+// The farthest apart two tiles of a valid line can be.
+const int kMaxLineSpan = 5;
+
+// A tile is packed into a byte as kPackedTile | color << 3 | shape, and an
+// empty square as 0.  Two tiles share a color if their packed bytes differ by
+// less than 8, and a shape if the difference's low bits are 0.
+const uint8_t kPackedTile = 0x40;
+const uint8_t kPackedShape = 0x07;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#if defined(__AVX2__)
+const int kGridLanes = 32;
+typedef __m256i GridVector;
+
+inline GridVector gridLoad(const uint8_t* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+inline void gridStore(uint8_t* p, GridVector v) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+}
+inline GridVector gridSplat(uint8_t b) { return _mm256_set1_epi8(b); }
+inline GridVector gridAnd(GridVector a, GridVector b) {
+  return _mm256_and_si256(a, b);
+}
+inline GridVector gridAndNot(GridVector a, GridVector b) {
+  return _mm256_andnot_si256(a, b);
+}
+inline GridVector gridOr(GridVector a, GridVector b) {
+  return _mm256_or_si256(a, b);
+}
+inline GridVector gridXor(GridVector a, GridVector b) {
+  return _mm256_xor_si256(a, b);
+}
+inline GridVector gridAdd(GridVector a, GridVector b) {
+  return _mm256_add_epi8(a, b);
+}
+inline GridVector gridSub(GridVector a, GridVector b) {
+  return _mm256_sub_epi8(a, b);
+}
+inline GridVector gridEqual(GridVector a, GridVector b) {
+  return _mm256_cmpeq_epi8(a, b);
+}
+inline GridVector gridGreater(GridVector a, GridVector b) {
+  return _mm256_cmpgt_epi8(a, b);
+}
+inline GridVector gridShiftLeft3(GridVector a) {
+  return _mm256_slli_epi16(a, 3);
+}
+inline bool gridAny(GridVector a) {
+  return _mm256_movemask_epi8(a) != 0;
+}
+#else
+const int kGridLanes = 16;
+typedef __m128i GridVector;
+
+inline GridVector gridLoad(const uint8_t* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+inline void gridStore(uint8_t* p, GridVector v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+inline GridVector gridSplat(uint8_t b) { return _mm_set1_epi8(b); }
+inline GridVector gridAnd(GridVector a, GridVector b) {
+  return _mm_and_si128(a, b);
+}
+inline GridVector gridAndNot(GridVector a, GridVector b) {
+  return _mm_andnot_si128(a, b);
+}
+inline GridVector gridOr(GridVector a, GridVector b) {
+  return _mm_or_si128(a, b);
+}
+inline GridVector gridXor(GridVector a, GridVector b) {
+  return _mm_xor_si128(a, b);
+}
+inline GridVector gridAdd(GridVector a, GridVector b) {
+  return _mm_add_epi8(a, b);
+}
+inline GridVector gridSub(GridVector a, GridVector b) {
+  return _mm_sub_epi8(a, b);
+}
+inline GridVector gridEqual(GridVector a, GridVector b) {
+  return _mm_cmpeq_epi8(a, b);
+}
+inline GridVector gridGreater(GridVector a, GridVector b) {
+  return _mm_cmpgt_epi8(a, b);
+}
+inline GridVector gridShiftLeft3(GridVector a) {
+  return _mm_slli_epi16(a, 3);
+}
+inline bool gridAny(GridVector a) {
+  return _mm_movemask_epi8(a) != 0;
+}
+#endif
+
+// Packs the squares [begin, end) of a grid row into out, or if in is null
+// empties them.  begin and end are multiples of kGridLanes.
+inline void packGridRow(const uint8_t* in, uint8_t* out, int begin, int end) {
+  const GridVector zero = gridSplat(0);
+  const GridVector one = gridSplat(1);
+  for (int i = begin; i < end; i += kGridLanes) {
+    if (in == nullptr) {
+      gridStore(out + i, zero);
+      continue;
+    }
+    GridVector cell = gridLoad(in + i);
+    // code / 6 is the number of multiples of 6 up to the code.  An empty
+    // square's code comes out as -1, so it counts none.
+    GridVector code = gridSub(cell, one);
+    GridVector color = zero;
+    for (int limit = 5; limit < 30; limit += 6) {
+      color = gridSub(color, gridGreater(code, gridSplat(limit)));
+    }
+    GridVector twice = gridAdd(color, color);
+    GridVector shape = gridSub(code, gridAdd(twice, gridAdd(twice, twice)));
+    // color is at most 5, so shifting 16 bit lanes moves no bits between
+    // bytes.
+    GridVector packed = gridOr(gridSplat(kPackedTile),
+			       gridOr(gridShiftLeft3(color), shape));
+    gridStore(out + i, gridAndNot(gridEqual(cell, zero), packed));
+  }
+}
+
+// Checks the lines from each of the kGridLanes squares from p in a packed
+// grid, going along the row (step 1) or up the column (step -kGridSize).
+inline bool isValidGridChunk(const uint8_t* p, int step) {
+  const GridVector zero = gridSplat(0);
+  const GridVector shape_bits = gridSplat(kPackedShape);
+  const GridVector color_step = gridSplat(8);
+  GridVector square = gridLoad(p);
+  // span holds the tiles followed by d more in their line, and bad the tiles
+  // followed within their line by one they don't go with.
+  GridVector span = gridAndNot(gridEqual(square, zero), gridEqual(zero, zero));
+  GridVector bad = zero;
+  for (int d = 1; d <= kMaxLineSpan; d++) {
+    GridVector next = gridLoad(p + d * step);
+    span = gridAndNot(gridEqual(next, zero), span);
+    if (!gridAny(span)) {
+      return !gridAny(bad);
+    }
+    GridVector diff = gridXor(square, next);
+    GridVector shares = gridOr(gridGreater(color_step, diff),
+			       gridEqual(gridAnd(diff, shape_bits), zero));
+    bad = gridOr(bad, gridAndNot(shares, span));
+    bad = gridOr(bad, gridAnd(span, gridEqual(diff, zero)));
+  }
+  // Any line still going is too long.
+  span = gridAndNot(gridEqual(gridLoad(p + (kMaxLineSpan + 1) * step), zero),
+		    span);
+  return !gridAny(gridOr(bad, span));
+}
+
+#else
+
+// The scalar fallback works a square at a time, on the same packed grid.
+const int kGridLanes = 8;
+
+inline void packGridRow(const uint8_t* in, uint8_t* out, int begin, int end) {
+  for (int i = begin; i < end; i++) {
+    int code = in == nullptr ? -1 : in[i] - 1;
+    out[i] = code < 0 ? 0 : kPackedTile | (code / 6) << 3 | code % 6;
+  }
+}
+
+inline bool isValidGridChunk(const uint8_t* p, int step) {
+  for (int i = 0; i < kGridLanes; i++) {
+    if (p[i] == 0) {
+      continue;
+    }
+    for (int d = 1; p[i + d * step] != 0; d++) {
+      uint8_t diff = p[i] ^ p[i + d * step];
+      if (d > kMaxLineSpan || diff == 0 ||
+	  (diff >= 8 && (diff & kPackedShape) != 0)) {
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+#endif
+
+// Returns true if every line within rows [row_begin, row_end) and columns
+// [col_begin, col_end) of grid is valid.  Every square outside them must be
+// empty.
+inline bool isValidGrid(const uint8_t* grid, int row_begin, int row_end,
+			int col_begin, int col_end) {
+  if (row_begin >= row_end || col_begin >= col_end) {
+    return true;
+  }
+  // The packed copy has kMaxLineSpan + 1 empty rows above the grid's, for the
+  // columns to be followed into.  Rows are checked over whole vectors covering
+  // the columns, and lines are followed past the vector, so the squares up to
+  // the first empty one after the columns are packed too.  A line stops there,
+  // so anything read after it goes unused; the last row reads into padding.
+  const int kAbove = kMaxLineSpan + 1;
+  int begin = col_begin & ~(kGridLanes - 1);
+  int end = (col_end + kGridLanes - 1) & ~(kGridLanes - 1);
+  int pack_end =
+    (col_end < end) ? end : std::min(kGridSize, end + kGridLanes);
+  int height = row_end - row_begin;
+  alignas(32) uint8_t packed[(kGridSize + kAbove + 1) * kGridSize];
+  uint8_t* rows = packed + kAbove * kGridSize;
+  for (int r = -kAbove; r < 0; r++) {
+    packGridRow(nullptr, rows + r * kGridSize, begin, end);
+  }
+  for (int r = 0; r < height; r++) {
+    packGridRow(grid + (row_begin + r) * kGridSize, rows + r * kGridSize,
+		begin, pack_end);
+  }
+  packGridRow(nullptr, rows + height * kGridSize, 0, kGridLanes);
+
+  for (int r = 0; r < height; r++) {
+    const uint8_t* row = rows + r * kGridSize;
+    for (int i = begin; i < end; i += kGridLanes) {
+      if (!isValidGridChunk(row + i, 1) ||
+	  !isValidGridChunk(row + i, -kGridSize)) {
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+#endif // GRID_CHECK_H
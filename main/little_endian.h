@@ -0,0 +1,32 @@
+#ifndef LITTLE_ENDIAN_H
+#define LITTLE_ENDIAN_H
+
+#include <stdint.h>
+
+// Numbers in the binary files (game logs and snapshots) are little-endian
+// whatever the machine, and read and written a byte at a time so that they
+// needn't be aligned.
+
+inline void storeLE(uint8_t* p, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    p[i] = uint8_t(value >> (8 * i));
+  }
+}
+
+inline uint64_t loadLE(const uint8_t* p, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value |= uint64_t(p[i]) << (8 * i);
+  }
+  return value;
+}
+
+// loadLE(p, 8), written out so that compilers turn it into a single load on
+// little-endian machines, for loops which read many words.
+inline uint64_t loadLE64(const uint8_t* p) {
+  return uint64_t(p[0]) | uint64_t(p[1]) << 8 | uint64_t(p[2]) << 16 |
+    uint64_t(p[3]) << 24 | uint64_t(p[4]) << 32 | uint64_t(p[5]) << 40 |
+    uint64_t(p[6]) << 48 | uint64_t(p[7]) << 56;
+}
+
+#endif // LITTLE_ENDIAN_H
@@ -0,0 +1,65 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A whole file mapped read-only into memory, for reading binary files in
+// place rather than copying them in.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) :
+    data_(nullptr), size_(0), ok_(false) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      size_ = st.st_size;
+      if (size_ == 0) {
+	ok_ = true;  // mmap() can't map nothing
+      } else {
+	void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data != MAP_FAILED) {
+	  data_ = static_cast<const uint8_t*>(data);
+	  ok_ = true;
+	}
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<uint8_t*>(data_), size_);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Returns false if the file couldn't be opened and mapped.
+  bool ok() const { return ok_; }
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Tells the kernel the file will be read from start to end.
+  void adviseSequential() {
+    if (data_ != nullptr) {
+      madvise(const_cast<uint8_t*>(data_), size_, MADV_SEQUENTIAL);
+    }
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  bool ok_;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,159 @@
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "bag.h"
+#include "boardstate.h"
+#include "rack.h"
+#include "random.h"
+#include "search.h"
+#include "thread_pool.h"
+
+// Chooses moves by looking a few turns ahead.  The highest scoring moves are
+// the candidates.  Each sample makes up the tiles the player can't see (the
+// other player's rack and the order of the bag) by dealing the unseen tiles at
+// random, and plays every candidate out against it: each player then takes the
+// highest scoring move for a few turns, drawing from the made-up bag.  The
+// candidate which gains the most points over the other player, on average
+// across samples, is chosen.
+//
+// Every candidate is played out against the same samples, so that the
+// comparison between them isn't swamped by the luck of the draw.  Samples are
+// spread across the pool's threads, and each sample's tiles only depend on the
+// MonteCarlo's seed and the sample's number, so the choice is the same
+// whatever the number of threads.
+class MonteCarlo {
+ public:
+  static const int kDefaultCandidates = 8;
+  static const int kDefaultSamples = 200;
+  static const int kDefaultTurns = 2;
+
+  // Tries num_candidates moves, each in num_samples playouts which continue
+  // for num_turns turns after the candidate (the other player's first).
+  MonteCarlo(uint64_t seed, int num_candidates, int num_samples,
+	     int num_turns) :
+    random_(seed), num_candidates_(num_candidates), num_samples_(num_samples),
+    num_turns_(num_turns) {}
+
+  // Returns the chosen move for rack on board, or a move with no tiles if there
+  // is none.  If deadline passes, the samples played out so far decide, and
+  // *finished (if finished is not null) is set to false.
+  Move chooseMove(const BoardState& board,
+		  const Rack& rack,
+		  WorkStealingPool* pool,
+		  const Deadline& deadline,
+		  bool* finished) {
+    if (finished != nullptr) {
+      *finished = true;
+    }
+
+    // The candidates are the highest scoring moves, highest first, and in
+    // search order among moves which score the same.  So with one candidate
+    // this plays like findBestMove().
+    BoardState scratch = board;
+    Rack scratch_rack = rack;
+    TopMoves top_moves(num_candidates_);
+    forEachMove(&scratch, &scratch_rack, [&top_moves](const Move& move) {
+	top_moves.add(move);
+      });
+    std::vector<Move> candidates;
+    top_moves.sorted(&candidates);
+    if (candidates.size() <= 1) {
+      return candidates.empty() ? Move() : candidates[0];
+    }
+
+    std::vector<Tile> unseen = unseenTiles(board, rack);
+    std::vector<Tile> rack_tiles = rack.getTiles();
+    uint64_t seed = random_.next();
+    int num_candidates = candidates.size();
+    std::vector<int> margins(num_samples_ * num_candidates);
+    std::vector<char> sampled(num_samples_);
+    std::atomic<bool> stopped(false);
+    std::vector<BoardState> boards(pool->numThreads(), board);
+    pool->parallelFor(num_samples_,
+		      [&](int worker, int i) {
+			if (stopped.load(std::memory_order_relaxed) ||
+			    deadline.hasPassed()) {
+			  stopped.store(true, std::memory_order_relaxed);
+			  return;
+			}
+			for (int c = 0; c < num_candidates; c++) {
+			  // The same deal for every candidate.
+			  Bag bag(Random(seed + i), unseen);
+			  Rack other(&bag);
+			  Rack own(&bag, rack_tiles);
+			  margins[i * num_candidates + c] =
+			    playOut(&boards[worker], &own, &other,
+				    candidates[c]);
+			}
+			sampled[i] = true;
+		      });
+    if (finished != nullptr) {
+      *finished = !stopped.load();
+    }
+
+    std::vector<long> totals(num_candidates);
+    for (int i = 0; i < num_samples_; i++) {
+      if (sampled[i]) {
+	for (int c = 0; c < num_candidates; c++) {
+	  totals[c] += margins[i * num_candidates + c];
+	}
+      }
+    }
+    int best = 0;
+    for (int c = 1; c < num_candidates; c++) {
+      if (totals[c] > totals[best]) {
+	best = c;
+      }
+    }
+    return candidates[best];
+  }
+
+ private:
+  // Plays move with own, then plays on for num_turns_ turns, each player taking
+  // their highest scoring move (or passing if they have none) and refilling
+  // their rack from its bag.  Returns own's points minus other's.  The board is
+  // unchanged on return.
+  int playOut(BoardState* board, Rack* own, Rack* other, const Move& move) {
+    std::vector<std::pair<int, int>> placed;
+    Rack* racks[2] = {own, other};
+    int margin = 0;
+    Move next = move;
+    for (int turn = 0; turn <= num_turns_; turn++) {
+      int player = turn % 2;
+      if (turn > 0) {
+	next = greedyMove(board, racks[player]);
+      }
+      int sign = (player == 0) ? 1 : -1;
+      for (int i = 0; i < next.num_tiles; i++) {
+	const Placement& p = next.tiles[i];
+	board->insertTile(p.tile, p.x, p.y);
+	racks[player]->removeTile(p.tile);
+	placed.push_back(std::make_pair(p.x, p.y));
+      }
+      margin += sign * next.score;
+      racks[player]->populate();
+      if (racks[player]->size() == 0) {
+	margin += sign * kGoOutBonus;
+	break;
+      }
+    }
+
+    for (auto p = placed.rbegin(); p != placed.rend(); p++) {
+      board->removeTile(p->first, p->second);
+    }
+    return margin;
+  }
+
+  Random random_;
+  int num_candidates_;
+  int num_samples_;
+  int num_turns_;
+};
+
+#endif // MONTECARLO_H
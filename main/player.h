@@ -0,0 +1,83 @@
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include "bag.h"
+#include "boardstate.h"
+#include "montecarlo.h"
+#include "rack.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+// How the computer chooses its moves: the searches it uses, and what they keep
+// from one turn to the next.  Only pool is required, the rest may be null.
+// With none of them the computer plays the move which scores the most.
+struct ComputerPlayer {
+  explicit ComputerPlayer(WorkStealingPool* pool) :
+    pool(pool), cache(nullptr), table(nullptr), endgame(nullptr),
+    montecarlo(nullptr) {}
+
+  WorkStealingPool* pool;
+  MoveCache* cache;           // Should be kept for the one player
+  TranspositionTable* table;  // As for findBestMove()
+  EndgameSolver* endgame;     // Searches the game out once the bag is empty
+  MonteCarlo* montecarlo;     // Looks ahead while the bag still has tiles
+};
+
+// Plays the computer's turn: the best move it can find, or if no move is
+// possible an exchange of the entire rack.  Returns the move played, which has
+// a score of 0 if the rack was exchanged.  deadline and finished are as for
+// findBestMove().
+//
+// Once the bag is empty the rest of the game is searched with the player's
+// endgame solver, if it has one, and *finished is set to whether it searched
+// to the end of the game.  Before that (or without a solver) the player's
+// MonteCarlo chooses the move, if it has one.
+inline Move computerTurn(BoardState* board,
+			 Rack* rack,
+			 int* score,
+			 const ComputerPlayer& player,
+			 const Deadline& deadline,
+			 bool* finished) {
+  Move best_move;
+  int value;
+  bool exact;
+  bool bag_empty = (rack->bag() != nullptr && rack->bag()->tiles_left() == 0);
+  if (player.endgame != nullptr && bag_empty &&
+      player.endgame->solve(*board, *rack, deadline, &best_move, &value,
+			    &exact)) {
+    if (finished != nullptr) {
+      *finished = exact;
+    }
+  } else if (player.montecarlo != nullptr) {
+    best_move = player.montecarlo->chooseMove(*board, *rack, player.pool,
+					      deadline, finished);
+  } else {
+    best_move = findBestMove(*board, *rack, player.pool, player.cache,
+			     player.table, deadline, finished);
+  }
+
+  if (best_move.score > 0) {
+    *score += best_move.score;
+    for (int i = 0; i < best_move.num_tiles; i++) {
+      const Placement& p = best_move.tiles[i];
+      board->insertTile(p.tile, p.x, p.y);
+      rack->removeTile(p.tile);
+    }
+    rack->populate();
+
+  } else {
+    Rack new_rack(rack->bag());
+    // If the bag is almost empty it may not be possible to return the entire
+    // rack (say, if the bag has 3 tiles and the rack has 6).  In that case this
+    // code will do the slightly improper thing of returning 6 tiles and drawing
+    // 3.  The subsequent populate will fix this up (and otherwise be a no-op).
+    rack->bag()->return_tiles(rack->getTiles());
+    new_rack.populate();  // Usually a no-op
+    *rack = new_rack;
+  }
+
+  return best_move;
+}
+
+#endif // PLAYER_H
@@ -0,0 +1,142 @@
+#ifndef PONDER_H
+#define PONDER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "boardstate.h"
+#include "player.h"
+#include "rack.h"
+#include "search.h"
+
+// Searches the computer's reply in the background while its opponent (the
+// user) is thinking about their move.  The computer's rack doesn't change
+// during the opponent's turn, so the only unknown is the board the opponent
+// leaves, and the likeliest boards are the ones after the opponent's highest
+// scoring moves.  The Ponderer searches the computer's reply on each of those
+// in turn, exactly as findBestMove() would on the computer's turn, and the
+// search's result goes in the player's transposition table under the key of
+// that board and rack.  So if the opponent plays one of them, the computer's
+// own search finds its move in the table at once.
+//
+// Each reply is searched with its own copy of the player's move cache as it
+// was at the start, since the cache only follows one line of play.  When the
+// opponent's move matches, the copy made for it replaces the player's cache,
+// just as if the computer had searched that board itself.  So pondering
+// doesn't change the moves findBestMove() chooses, only how long they take
+// (except that a reply pondered to the end isn't cut short by a deadline).
+//
+// Only the search for the move which scores the most is pondered: a player
+// with a MonteCarlo or an endgame solver chooses some of its moves in other
+// ways, and those turns are searched as usual.
+class Ponderer {
+ public:
+  // Ponders the replies to up to num_moves of the opponent's moves, and to
+  // the opponent exchanging tiles (which leaves the board as it is).
+  Ponderer(const ComputerPlayer& player, int num_moves) :
+    player_(player), num_moves_(num_moves), cancelled_(false),
+    board_(), opponent_rack_(nullptr, std::vector<Tile>()),
+    rack_(nullptr, std::vector<Tile>()) {}
+
+  ~Ponderer() { cancel(); }
+
+  Ponderer(const Ponderer&) = delete;
+  Ponderer& operator=(const Ponderer&) = delete;
+
+  // Starts pondering the computer's replies, with rack, to the opponent's
+  // moves on board with opponent_rack.  The player's pool, cache and table
+  // belong to the Ponderer until stop() or cancel() is called, and mustn't be
+  // used until then.
+  void start(const BoardState& board, const Rack& opponent_rack,
+	     const Rack& rack) {
+    cancel();
+    board_ = board;
+    opponent_rack_ = opponent_rack;
+    rack_ = rack;
+    replies_.clear();
+    cancelled_.store(false);
+    thread_ = std::thread([this]() { run(); });
+  }
+
+  // Stops pondering, and returns true if the reply to board was pondered to
+  // the end, in which case the player's cache is now what that search left.
+  bool stop(const BoardState& board) {
+    cancel();
+    for (auto reply = replies_.begin(); reply != replies_.end(); reply++) {
+      if (reply->key == board.key()) {
+	if (player_.cache != nullptr) {
+	  *player_.cache = reply->cache;
+	}
+	return true;
+      }
+    }
+    return false;
+  }
+
+  // Stops pondering, and forgets what it found.
+  void cancel() {
+    cancelled_.store(true);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ private:
+  // A reply pondered to the end: the key of the board it was searched on, and
+  // the cache that search left.
+  struct Reply {
+    uint64_t key;
+    MoveCache cache;
+  };
+
+  void run() {
+    std::vector<Move> moves;
+    if (num_moves_ > 0) {
+      BoardState board = board_;
+      Rack rack = opponent_rack_;
+      TopMoves top_moves(num_moves_);
+      forEachMove(&board, &rack, [&top_moves](const Move& move) {
+	  top_moves.add(move);
+	});
+      top_moves.sorted(&moves);
+    }
+    moves.push_back(Move());  // An exchange
+
+    Deadline deadline = Deadline::cancelledBy(&cancelled_);
+    for (auto move = moves.begin(); move != moves.end(); move++) {
+      BoardState board = board_;
+      for (int i = 0; i < move->num_tiles; i++) {
+	const Placement& p = move->tiles[i];
+	board.insertTile(p.tile, p.x, p.y);
+      }
+      Reply reply;
+      reply.key = board.key();
+      if (player_.cache != nullptr) {
+	reply.cache = *player_.cache;
+      }
+      bool finished;
+      findBestMove(board, rack_, player_.pool,
+		   player_.cache != nullptr ? &reply.cache : nullptr,
+		   player_.table, deadline, &finished);
+      if (!finished) {
+	return;  // Cancelled
+      }
+      replies_.push_back(reply);
+    }
+  }
+
+  ComputerPlayer player_;
+  int num_moves_;
+  std::atomic<bool> cancelled_;
+  std::thread thread_;
+
+  // Only used by the thread while it runs.
+  BoardState board_;
+  Rack opponent_rack_;
+  Rack rack_;
+  std::vector<Reply> replies_;
+};
+
+#endif // PONDER_H
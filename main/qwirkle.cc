@@ -2,15 +2,25 @@
 #include <cstdlib>
 #include <ctime>
 #include <deque>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "bag.h"
 #include "boardstate.h"
+#include "game_log.h"
+#include "montecarlo.h"
+#include "player.h"
+#include "ponder.h"
 #include "rack.h"
+#include "search.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "thread_pool.h"
 
 // Parses the given command line.  Returns true on success.  All parameters are
 // output parameters except for cmd.
@@ -82,81 +92,16 @@ bool parseCmd(const std::string& cmd,
   return true;
 }
 
-// Given a board, the location of one tile, and whether that word is horizontal
-// or vertical -- compute the score of playing that specified tile.
-int scoreWord(BoardState board,
-	      int x, int y,
-	      bool horiz) {
-  // Starting at (x,y), find the start of the word and iterate over it to
-  // determine its length.
-  int len = 0;
-
-  // Rewind to the start of the word:
-  if (horiz) {
-    while (!board.isEmpty(x-1, y)) {
-      x--;
-    }
-  } else {
-    while (!board.isEmpty(x, y-1)) {
-      y--;
-    }
-  }
-
-  // Count the tiles in the word:
-  while (!board.isEmpty(x, y)) {
-    len++;
-    if (horiz) {
-      x++;
-    } else {
-      y++;
-    }
-  }
-
-  // If the word is 6 long, then you have a Qwirkle and its score is doubled:
-  return (len == 6) ? 12 : len;
-}
-
-// Compute the score of playing a particular set of tiles on the board.  You
-// need to say whether those tiles are horizontally or vertically aligned (note
-// that this doesn't matter if there is only one tile).
-int scoreMove(BoardState board,
-	      std::vector<std::pair<int, int>> tile_locations,
-	      bool horiz) {
-  int score = 0;
-
-  // First compute the score of the word formed directly by putting down these
-  // tiles.  Can start from any tile in the word, pick the first one
-  // arbitrarily.
-  int primary_score = scoreWord(board,
-				tile_locations.begin()->first,
-				tile_locations.begin()->second,
-				horiz);
-  if (primary_score > 1) {
-    // Either this is the first move of the game and a single tile (which will
-    // be handled by the caller), or a single tile was played and it only
-    // generates multi-tile worlds in the other direction (and will be counted
-    // below).
-    score += primary_score;
-  }
-  
-  // For each tile played compute the score of any words formed perpendicular to
-  // the primary word.  Don't count single-tile words.
-  for (auto i = tile_locations.begin(); i != tile_locations.end(); i++) {
-    int secondary_score = scoreWord(board, i->first, i->second, !horiz);
-    if (secondary_score > 1) {
-      score += secondary_score;
-    }
-  }
-
-  return score;
-}
-
+// Plays the user's command, if it is a valid move.  Returns true if it was.
+// The move is added to recorder, if it is not null.
 bool runCmd(std::string cmd,
 	    BoardState* board,
 	    Rack* rack,
 	    int* score,
-	    bool first_move) {
+	    bool first_move,
+	    GameRecorder* recorder) {
   bool valid_move_played = false;
+  Rack before = *rack;
 
   int x, y;
   std::vector<int> tile_nums;
@@ -164,11 +109,12 @@ bool runCmd(std::string cmd,
   if(parseCmd(cmd, &directive, &x, &y, &tile_nums, rack->size())) {
 
     // Convert tile numbers to actual tiles in the rack:
+    std::vector<Tile> rack_tiles = rack->getTiles();
     std::vector<Tile> tiles;
     tiles.reserve(tile_nums.size());
     std::for_each(tile_nums.begin(), tile_nums.end(),
-		  [&tiles, rack](int num)
-		  {tiles.push_back(rack->getTiles()[num]);});
+		  [&tiles, &rack_tiles](int num)
+		  {tiles.push_back(rack_tiles[num]);});
 
     if (directive == 'r') {
       // Return tiles from rack and get new ones from bag.
@@ -185,6 +131,9 @@ bool runCmd(std::string cmd,
 	// all the returned tiles?  We'll just refill our rack with a random
 	// choice of our returned tiles:
 	rack->populate();
+	if (recorder != nullptr) {
+	  recorder->exchange(0, tiles, before, *rack);
+	}
       
 	valid_move_played = true;
 
@@ -200,7 +149,11 @@ bool runCmd(std::string cmd,
       // Is this move building on the tiles that have already been played?
       bool adjacent = false;
 
-      std::vector<std::pair<int,int>> tile_locs;
+      Move move;
+      move.horiz = horiz;
+
+      // Is every tile within reach of the board?
+      bool on_board = true;
 
       for (auto tile = tiles.begin(); tile != tiles.end(); tile++) {
 	while (!newboard.isEmpty(x, y)) {
@@ -213,15 +166,28 @@ bool runCmd(std::string cmd,
 	  }
 	}
 
+	if (!newboard.canHold(x, y)) {
+	  on_board = false;
+	  break;
+	}
+
 	if (board->isAdjacent(x, y)) {
 	  adjacent = true;
 	}
 	newboard.insertTile(*tile, x, y);
-	tile_locs.push_back(std::pair<int,int>(x, y));
+	move.push(*tile, x, y);
       }
 
-      if (newboard.isValidBoard() && (adjacent || first_move)) {
-	int move_score = scoreMove(newboard, tile_locs, horiz);
+      // The board was valid before this move, so only words running through
+      // the tiles just placed need to be checked.
+      bool valid = on_board;
+      for (int i = 0; valid && i < move.num_tiles; i++) {
+	valid = newboard.isValidAfterPlacing(move.tiles[i].x, move.tiles[i].y);
+      }
+      assert(!valid || newboard.isValidBoard());
+
+      if (valid && (adjacent || first_move)) {
+	int move_score = scoreMove(newboard, move);
 
 	// Special case: if the player plays just 1 tile on the first move then
 	// our scoring routine won't find any words > length 1 formed -- and
@@ -241,6 +207,10 @@ bool runCmd(std::string cmd,
 	}
       
 	rack->populate();
+	if (recorder != nullptr) {
+	  move.score = move_score;
+	  recorder->move(0, move, before, *rack);
+	}
 
 	valid_move_played = true;
 
@@ -253,10 +223,14 @@ bool runCmd(std::string cmd,
   return valid_move_played;
 }
 
+// Reads commands until the user has made a valid move.  "save FILE" isn't a
+// move: it calls save with FILE, to save a snapshot of the game.
 void userTurn(BoardState* board,
 	      Rack* rack,
 	      int* score,
-	      bool first_move) {
+	      bool first_move,
+	      GameRecorder* recorder,
+	      const std::function<void(const std::string&)>& save) {
   bool valid_move_played = false;
 
   while (!valid_move_played && std::cin.good() && !std::cin.eof()) {
@@ -264,172 +238,117 @@ void userTurn(BoardState* board,
     std::string cmd;
     std::getline(std::cin, cmd);
 
-    valid_move_played = runCmd(cmd, board, rack, score, first_move);
+    if (cmd.compare(0, 5, "save ") == 0) {
+      save(cmd.substr(5));
+      continue;
+    }
+    valid_move_played = runCmd(cmd, board, rack, score, first_move,
+			       recorder);
   }
 }
 
-struct Move {
-  Move(BoardState b, Rack r, int s) : newboard(b), depleted_rack(r), score(s) {}
-  Move(BoardState b, Rack r) : newboard(b), depleted_rack(r), score(0) {}
-
-  BoardState newboard;
-  Rack depleted_rack;
-  int score;
-};
 	    
-// If we've started a move on the board, recursively evaluate all possible moves
-// in a given direction (up, down, left or right) using the tiles we have left
-// on our rack to find the best move.
-Move bestMoveGivenPrefix(BoardState board,
-			 Rack rack,
-			 int x, int y,
-			 std::vector<std::pair<int,int>> tile_locs,
-			 int dx, int dy) {
-  assert((dx ==  1 && dy ==  0) ||
-	 (dx == -1 && dy ==  0) ||
-	 (dx ==  0 && dy ==  1) ||
-	 (dx ==  0 && dy == -1));
-
-  bool horiz = (dx != 0);
-  Move best_move(board, rack, scoreMove(board, tile_locs, horiz));
-
-  while(!board.isEmpty(x, y)) {
-    x += dx;
-    y += dy;
-  }
-
-  // Loop through all the tiles on our rack and see if we can add any to the
-  // board and improve our move.
-  std::vector<Tile> rack_tiles(rack.getTiles());
-  for (auto tile = rack_tiles.begin(); tile != rack_tiles.end(); tile++) {
-    BoardState new_board(board);
-    Rack new_rack(rack);
-    std::vector<std::pair<int,int>> new_tile_locs(tile_locs);
-    new_board.insertTile(*tile, x, y);
-    new_rack.removeTile(*tile);
-    if (new_board.isValidBoard()) {
-      new_tile_locs.push_back(std::pair<int,int>(x, y));
-      // We found a move we can make!  Recurse to see if there are more tiles we
-      // can place.
-      Move submove = bestMoveGivenPrefix(new_board, new_rack, x, y,
-					 new_tile_locs, dx, dy);
-
-      if (submove.score > best_move.score) {
-	best_move = submove;
-      }
+int main(int argc, char** argv) {
+  int num_threads = 1;
+  int move_time_ms = 0;
+  long endgame_nodes = EndgameSolver::kDefaultNodeLimit;
+  int ponder_moves = 8;
+  std::string strategy = "greedy";
+  std::string stats_format;  // Empty for no --stats
+  std::string log_path;      // Empty for no --log
+  std::string load_path;     // Empty for no --load
+  uint64_t seed = std::time(0);
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 10, "--threads=") == 0) {
+      num_threads = std::max(1, std::atoi(arg.c_str() + 10));
+    } else if (arg.compare(0, 7, "--seed=") == 0) {
+      seed = std::strtoull(arg.c_str() + 7, nullptr, 10);
+    } else if (arg.compare(0, 15, "--move_time_ms=") == 0) {
+      move_time_ms = std::max(0, std::atoi(arg.c_str() + 15));
+    } else if (arg.compare(0, 16, "--endgame_nodes=") == 0) {
+      endgame_nodes = std::max(0L, std::atol(arg.c_str() + 16));
+    } else if (arg.compare(0, 11, "--strategy=") == 0) {
+      strategy = arg.substr(11);
+    } else if (arg.compare(0, 15, "--ponder_moves=") == 0) {
+      ponder_moves = std::max(0, std::atoi(arg.c_str() + 15));
+    } else if (arg == "--stats" || arg == "--stats=text") {
+      stats_format = "text";
+    } else if (arg == "--stats=json") {
+      stats_format = "json";
+    } else if (arg.compare(0, 6, "--log=") == 0) {
+      log_path = arg.substr(6);
+    } else if (arg.compare(0, 7, "--load=") == 0) {
+      load_path = arg.substr(7);
+    } else {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return 1;
     }
   }
-  return best_move;
-}
-			 
-// Given a starting location, find the best move possible that includes putting
-// a tile at that location.  If no move is possible return a move with a score
-// of 0.
-Move bestMove(BoardState board,
-	      Rack rack,
-	      int x, int y) {
-  Move move(board, rack);
-
-  // A move is only possible if it starts next to existing tiles
-  if (board.isEmpty(x, y) && board.isAdjacent(x, y)) {
-    std::vector<Tile> rack_tiles(rack.getTiles());
-
-    // Try every tile in this location to see what we can do:
-    for (auto tile = rack_tiles.begin(); tile != rack_tiles.end(); tile++) {
-      BoardState new_board(board);
-      Rack new_rack(rack);
-      new_board.insertTile(*tile, x, y);
-      new_rack.removeTile(*tile);
-
-      if (new_board.isValidBoard()) {
-	// We found a move we can make!  Now explore in all four directions (up,
-	// down, left and right) to find the highest scoring word we can build
-	// in that direction.
-	std::vector<std::pair<int,int>> tile_locs;
-	tile_locs.push_back(std::pair<int,int>(x, y));
-
-	Move right = bestMoveGivenPrefix(new_board, new_rack, x, y, tile_locs,
-					 1, 0);
-	if (right.score > move.score) {
-	  move = right;
-	}
-
-	Move left = bestMoveGivenPrefix(new_board, new_rack, x, y, tile_locs,
-					-1, 0);
-	if (left.score > move.score) {
-	  move = left;
-	}
-
-	Move down = bestMoveGivenPrefix(new_board, new_rack, x, y, tile_locs,
-					0, 1);
-	if (down.score > move.score) {
-	  move = down;
-	}
-
-	Move up = bestMoveGivenPrefix(new_board, new_rack, x, y, tile_locs,
-				      0, -1);
-	if (up.score > move.score) {
-	  move = up;
-	}
-      }
-    }
+  if (strategy != "greedy" && strategy != "montecarlo") {
+    std::cerr << "Unknown strategy " << strategy << std::endl;
+    return 1;
   }
-
-  return move;
-}
-
-void computerTurn(BoardState* board,
-		  Rack* rack,
-		  int* score) {
-  // Approach: exhaustive search.  Start at each square in the board (taking the
-  // extents of the current board and adding one to each edge).  For each
-  // square, try to place each tile in our rack.  If a placement is legal, then
-  // start searching in all four directions (horizontal and vertical) to see of
-  // any additional tiles can be placed.  Once either no placement is possible
-  // or the rack is exhausted, record the move required to get there.
-
-  Move best_move(*board, *rack);
-  for (int x = board->minX()-1; x <= board->maxX(); x++) {
-    for (int y = board->minY()-1; y <= board->maxY(); y++) {
-      Move best_move_at_location = bestMove(*board, *rack, x, y);
-      if (best_move_at_location.score > best_move.score) {
-	best_move = best_move_at_location;
-      }
+  if (!stats_format.empty() && !kSearchStats) {
+    std::cerr << "Built with NO_SEARCH_STATS: only nodes are counted."
+	      << std::endl;
+  }
+  if (!log_path.empty() && !load_path.empty()) {
+    // Logs replay games from the start.
+    std::cerr << "Can't log a game loaded from a snapshot" << std::endl;
+    return 1;
+  }
+  std::unique_ptr<GameLogWriter> log;
+  if (!log_path.empty()) {
+    log.reset(new GameLogWriter(log_path));
+    if (!log->ok()) {
+      std::cerr << "Can't open " << log_path << std::endl;
+      return 1;
     }
   }
-
-  if (best_move.score > 0) {
-    std::cout << "Computer Move Score=" << best_move.score << std::endl;
-    *score += best_move.score;
-    *board = best_move.newboard;
-    *rack = best_move.depleted_rack;
-    rack->populate();
-
-  } else {
-    std::cout << "OH NO, NO MOVES POSSIBLE!  Exchanging entire rack."
-	      << std::endl;
-    Rack new_rack(rack->bag());
-    // If the bag is almost empty it may not be possible to return the entire
-    // rack (say, if the bag has 3 tiles and the rack has 6).  In that case this
-    // code will do the slightly improper thing of returning 6 tiles and drawing
-    // 3.  The subsequent populate will fix this up (and otherwise be a no-op).
-    rack->bag()->return_tiles(rack->getTiles());
-    new_rack.populate();  // Usually a no-op
-    *rack = new_rack;
+  WorkStealingPool pool(num_threads);
+  MoveCache cache;
+  TranspositionTable table(16);
+  EndgameSolver endgame(&table, endgame_nodes);
+  MonteCarlo montecarlo(~seed, MonteCarlo::kDefaultCandidates,
+			MonteCarlo::kDefaultSamples, MonteCarlo::kDefaultTurns);
+  ComputerPlayer player(&pool);
+  player.cache = &cache;
+  player.table = &table;
+  if (endgame_nodes > 0) {
+    player.endgame = &endgame;
   }
-}
-
-int main() {
-  std::srand(std::time(0));
+  if (strategy == "montecarlo") {
+    player.montecarlo = &montecarlo;
+  }
+  // Declared after the player's searches, so it stops before they go.
+  Ponderer ponderer(player, ponder_moves);
 
   BoardState board;
-  Bag bag;
-  bag.shuffle();
+  Bag bag(seed);
   Rack user_rack(&bag);
   Rack computer_rack(&bag);
+  // The user is player 0 in the log, the computer player 1.
+  GameRecorder recorder(seed, user_rack, computer_rack);
   bool first_move = true;
   int user_score = 0;
   int computer_score = 0;
+  if (!load_path.empty()) {
+    if (!loadSnapshot(load_path, &board, &user_rack, &computer_rack, &bag,
+		      &user_score, &computer_score, false)) {
+      std::cerr << "Can't load a snapshot from " << load_path << std::endl;
+      return 1;
+    }
+    first_move = (board.minX() == board.maxX());
+  }
+  auto save = [&](const std::string& path) {
+    if (saveSnapshot(path, board, user_rack, computer_rack, bag,
+		     user_score, computer_score)) {
+      std::cout << "Saved to " << path << std::endl;
+    } else {
+      std::cout << "Can't save to " << path << std::endl;
+    }
+  };
 
   while(std::cin.good() && !std::cin.eof()) {
     std::cout << "Your score: " << user_score
@@ -444,22 +363,67 @@ int main() {
 		<< " TILES LEFT." << std::endl;
     }
 
-    userTurn(&board, &user_rack, &user_score, first_move);
+    // The computer's own turn is pondered unless a MonteCarlo or the endgame
+    // solver will choose its move.
+    bool ponder = ponder_moves > 0 && player.montecarlo == nullptr &&
+      (player.endgame == nullptr || bag.tiles_left() > 0);
+    if (ponder) {
+      ponderer.start(board, user_rack, computer_rack);
+    }
+    userTurn(&board, &user_rack, &user_score, first_move, &recorder, save);
     first_move = false;
+    bool pondered = ponder && ponderer.stop(board);
 
     if (!std::cin.good() || std::cin.eof()) {
       break;
     }
 
     if (user_rack.size() == 0) {
-      user_score += 6;
+      user_score += kGoOutBonus;
       break;
     }
 
-    computerTurn(&board, &computer_rack, &computer_score);
+    Deadline deadline = (move_time_ms > 0) ?
+      Deadline::after(move_time_ms) : Deadline();
+    bool finished;
+    TurnStats stats;
+    stats.board_tiles = Bag::kNumTiles - bag.tiles_left() - user_rack.size() -
+      computer_rack.size();
+    stats.board_width = board.maxX() - board.minX();
+    stats.board_height = board.maxY() - board.minY();
+    StatsTimer timer;
+    Rack before = computer_rack;
+    Move computer_move = computerTurn(&board, &computer_rack, &computer_score,
+				      player, deadline, &finished);
+    stats.counters = timer.counters();
+    stats.seconds = timer.seconds();
+    if (computer_move.num_tiles > 0) {
+      recorder.move(1, computer_move, before, computer_rack);
+    } else {
+      recorder.exchange(1, before.getTiles(), before, computer_rack);
+    }
+    if (computer_move.score > 0) {
+      std::cout << "Computer Move Score=" << computer_move.score;
+      if (!finished && deadline.hasPassed()) {
+	std::cout << " (out of time, best found)";
+      }
+      std::cout << std::endl;
+    } else {
+      std::cout << "OH NO, NO MOVES POSSIBLE!  Exchanging entire rack."
+		<< std::endl;
+    }
+    if (stats_format == "text") {
+      std::cout << "Search: ";
+      stats.print(std::cout);
+      std::cout << (pondered ? ", pondered" : "") << std::endl;
+    } else if (stats_format == "json") {
+      std::cout << "{";
+      stats.printJson(std::cout);
+      std::cout << ",\"pondered\":" << (pondered ? 1 : 0) << "}" << std::endl;
+    }
 
     if (computer_rack.size() == 0) {
-      computer_score += 6;
+      computer_score += kGoOutBonus;
       break;
     }
   }
@@ -471,6 +435,10 @@ int main() {
   std::cout << std::endl;
   user_rack.print();
 
+  if (log && !log->append(recorder.finish(user_score, computer_score))) {
+    std::cerr << "Error writing " << log_path << std::endl;
+    return 1;
+  }
   return 0;
 }
 
@@ -0,0 +1,355 @@
+// Microbenchmarks for the hot paths of the engine: scoring, validation and
+// move generation.  Each benchmark runs over a corpus of saved early, mid and
+// late game positions (and a few at the edge of the grid) and reports time,
+// heap allocations and search nodes per operation, compared against a stored
+// baseline.
+//
+// Usage: qwirkle_bench [--positions=FILE] [--baseline=FILE]
+//                      [--save_baseline=FILE] [--min_time=SECONDS]
+//                      [--filter=SUBSTRING]
+//
+// The defaults read main/testdata/bench_positions.txt and compare against
+// main/testdata/bench_baseline.txt.  Build optimized, without assertions (the
+// search asserts on whole-board validity in debug builds):
+//
+//   bazel run -c opt --copt=-DNDEBUG //main:qwirkle_bench
+//
+// After a change that is meant to speed things up, add
+// --save_baseline=$PWD/main/testdata/bench_baseline.txt to record the new
+// numbers, and commit them with the change, so that the next change is
+// compared against them rather than against older code.  Timings vary from
+// machine to machine, so save the baseline on the machine that measured the
+// speedup.
+//
+// The edge positions fill the grid as far as it goes, so a debug build run
+// with --min_time=0 also checks that the search never steps off it.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bag.h"
+#include "boardstate.h"
+#include "rack.h"
+#include "search.h"
+#include "thread_pool.h"
+
+// Count every heap allocation made by the process.
+static std::atomic<long> allocations(0);
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+struct Position {
+  Position() : rack(nullptr, std::vector<Tile>()) {}
+
+  std::string name;
+  std::string phase;  // early, mid, late or edge
+  BoardState board;
+  Rack rack;
+};
+
+// Reads positions in the format described at the top of the corpus file.
+bool loadPositions(const std::string& path, std::vector<Position>* positions) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string rack;
+    positions->push_back(Position());
+    Position* position = &positions->back();
+    fields >> position->name >> position->phase >> rack;
+
+    std::vector<Tile> tiles;
+    std::istringstream rack_fields(rack);
+    int code;
+    char comma;
+    while (rack_fields >> code) {
+      tiles.push_back(Tile::fromCode(code));
+      rack_fields >> comma;
+    }
+    position->rack = Rack(nullptr, tiles);
+
+    int x, y;
+    while (fields >> x >> comma >> y >> comma >> code) {
+      position->board.insertTile(Tile::fromCode(code), x, y);
+    }
+  }
+  return true;
+}
+
+struct Result {
+  double ns_per_op;
+  double allocations_per_op;
+  double nodes_per_op;
+};
+
+// Calls fn repeatedly for at least min_seconds.  fn returns the number of
+// operations it performed.
+template <typename Fn>
+Result measure(Fn fn, double min_seconds) {
+  long ops = 0;
+  long start_allocations = allocations.load();
+  long start_nodes = search_counters.nodes;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed(0);
+  while (ops == 0 || elapsed.count() < min_seconds) {
+    ops += fn();
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+
+  Result result;
+  result.ns_per_op = 1e9 * elapsed.count() / ops;
+  result.allocations_per_op =
+    double(allocations.load() - start_allocations) / ops;
+  result.nodes_per_op = double(search_counters.nodes - start_nodes) / ops;
+  return result;
+}
+
+// Keeps the compiler from optimizing away benchmarked calls.
+static volatile long sink;
+
+long benchScoreWord(const std::vector<const Position*>& positions) {
+  long ops = 0;
+  for (auto p = positions.begin(); p != positions.end(); p++) {
+    const BoardState& board = (*p)->board;
+    for (int x = board.minX(); x < board.maxX(); x++) {
+      for (int y = board.minY(); y < board.maxY(); y++) {
+	if (!board.isEmpty(x, y)) {
+	  sink += scoreWord(board, x, y, true);
+	  sink += scoreWord(board, x, y, false);
+	  ops += 2;
+	}
+      }
+    }
+  }
+  return ops;
+}
+
+// Scores the best move in each position, with its tiles already placed.
+long benchScoreMove(const std::vector<std::pair<BoardState, Move>>& moves) {
+  for (auto m = moves.begin(); m != moves.end(); m++) {
+    sink += scoreMove(m->first, m->second);
+  }
+  return moves.size();
+}
+
+long benchIsValidBoard(const std::vector<const Position*>& positions) {
+  for (auto p = positions.begin(); p != positions.end(); p++) {
+    sink += (*p)->board.isValidBoard();
+  }
+  return positions.size();
+}
+
+// Runs bestMoveGivenPrefix in every direction from every legal first tile at
+// every anchor.  Each of those top-level calls is one operation.
+long benchBestMoveGivenPrefix(const std::vector<const Position*>& positions,
+			      std::vector<BoardState>* boards) {
+  const int kDirections[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+  long ops = 0;
+  for (size_t p = 0; p < positions.size(); p++) {
+    BoardState* board = &(*boards)[p];
+    Rack rack = positions[p]->rack;
+    std::vector<Anchor> anchors = findAnchors(*board);
+    for (auto anchor = anchors.begin(); anchor != anchors.end(); anchor++) {
+      TileSet candidates = anchor->legal_tiles & rack.tileSet();
+      for (; candidates != 0; candidates &= candidates - 1) {
+	Tile tile = Tile::fromCode(firstTile(candidates));
+	rack.removeTile(tile);
+	board->insertTile(tile, anchor->x, anchor->y);
+	for (int d = 0; d < 4; d++) {
+	  Move move;
+	  Move best_move;
+	  move.push(tile, anchor->x, anchor->y);
+	  bestMoveGivenPrefix(board, &rack, anchor->x, anchor->y, &move,
+			      kDirections[d][0], kDirections[d][1],
+			      &best_move, nullptr);
+	  sink += best_move.score;
+	  ops++;
+	}
+	board->removeTile(anchor->x, anchor->y);
+	rack.addTile(tile);
+      }
+    }
+  }
+  return ops;
+}
+
+long benchFindBestMove(const std::vector<const Position*>& positions,
+		       WorkStealingPool* pool) {
+  for (auto p = positions.begin(); p != positions.end(); p++) {
+    sink += findBestMove((*p)->board, (*p)->rack, pool, nullptr, nullptr,
+				 Deadline(), nullptr).score;
+  }
+  return positions.size();
+}
+
+int main(int argc, char** argv) {
+  std::string positions_path = "main/testdata/bench_positions.txt";
+  std::string baseline_path = "main/testdata/bench_baseline.txt";
+  std::string save_baseline_path;
+  std::string filter;
+  double min_time = 0.5;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 12, "--positions=") == 0) {
+      positions_path = arg.substr(12);
+    } else if (arg.compare(0, 11, "--baseline=") == 0) {
+      baseline_path = arg.substr(11);
+    } else if (arg.compare(0, 16, "--save_baseline=") == 0) {
+      save_baseline_path = arg.substr(16);
+    } else if (arg.compare(0, 11, "--min_time=") == 0) {
+      min_time = std::atof(arg.c_str() + 11);
+    } else if (arg.compare(0, 9, "--filter=") == 0) {
+      filter = arg.substr(9);
+    } else {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Position> positions;
+  if (!loadPositions(positions_path, &positions) || positions.empty()) {
+    std::cerr << "Can't read positions from " << positions_path << std::endl;
+    return 1;
+  }
+
+  // Baseline lines are "<benchmark> <phase> <ns/op>".
+  std::map<std::string, double> baseline;
+  {
+    std::ifstream in(baseline_path);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') {
+	continue;
+      }
+      std::istringstream fields(line);
+      std::string name, phase;
+      double ns;
+      if (fields >> name >> phase >> ns) {
+	baseline[name + " " + phase] = ns;
+      }
+    }
+  }
+
+  WorkStealingPool pool(1);
+  std::ostringstream new_baseline;
+  new_baseline << "# qwirkle_bench baseline: <benchmark> <phase> <ns/op>"
+	       << std::endl;
+
+  std::cout << std::left << std::setw(22) << "benchmark"
+	    << std::setw(7) << "phase"
+	    << std::right << std::setw(12) << "ns/op"
+	    << std::setw(12) << "allocs/op"
+	    << std::setw(12) << "nodes/op"
+	    << std::setw(12) << "baseline"
+	    << std::setw(9) << "change" << std::endl;
+
+  const char* phases[] = {"early", "mid", "late", "edge"};
+  for (const char* phase : phases) {
+    std::vector<const Position*> selected;
+    for (auto p = positions.begin(); p != positions.end(); p++) {
+      if (p->phase == phase) {
+	selected.push_back(&*p);
+      }
+    }
+    if (selected.empty()) {
+      continue;
+    }
+
+    // Set up the inputs which some benchmarks modify or derive.
+    std::vector<BoardState> boards;
+    std::vector<std::pair<BoardState, Move>> best_moves;
+    for (auto p = selected.begin(); p != selected.end(); p++) {
+      boards.push_back((*p)->board);
+      Move move = findBestMove((*p)->board, (*p)->rack, &pool, nullptr, nullptr,
+				Deadline(), nullptr);
+      if (move.score > 0) {
+	best_moves.push_back(std::make_pair((*p)->board, move));
+	for (int i = 0; i < move.num_tiles; i++) {
+	  best_moves.back().first.insertTile(move.tiles[i].tile,
+					     move.tiles[i].x, move.tiles[i].y);
+	}
+      }
+    }
+
+    std::vector<std::pair<std::string, std::function<long()>>> benchmarks = {
+      {"scoreWord",
+       [&](){ return benchScoreWord(selected); }},
+      {"scoreMove",
+       [&](){ return benchScoreMove(best_moves); }},
+      {"isValidBoard",
+       [&](){ return benchIsValidBoard(selected); }},
+      {"bestMoveGivenPrefix",
+       [&](){ return benchBestMoveGivenPrefix(selected, &boards); }},
+      {"findBestMove",
+       [&](){ return benchFindBestMove(selected, &pool); }},
+    };
+
+    for (auto b = benchmarks.begin(); b != benchmarks.end(); b++) {
+      if (b->first.find(filter) == std::string::npos) {
+	continue;
+      }
+      Result result = measure(b->second, min_time);
+      new_baseline << b->first << " " << phase << " " << std::fixed
+		   << std::setprecision(1) << result.ns_per_op << std::endl;
+
+      std::cout << std::left << std::setw(22) << b->first
+		<< std::setw(7) << phase
+		<< std::right << std::fixed
+		<< std::setprecision(1) << std::setw(12) << result.ns_per_op
+		<< std::setprecision(2)
+		<< std::setw(12) << result.allocations_per_op
+		<< std::setw(12) << result.nodes_per_op;
+      auto base = baseline.find(b->first + " " + phase);
+      if (base != baseline.end()) {
+	double change = 100 * (result.ns_per_op / base->second - 1);
+	std::cout << std::setprecision(1) << std::setw(12) << base->second
+		  << std::setw(8) << std::showpos << change << "%"
+		  << std::noshowpos;
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  if (!save_baseline_path.empty()) {
+    std::ofstream out(save_baseline_path);
+    out << new_baseline.str();
+    if (!out) {
+      std::cerr << "Can't write " << save_baseline_path << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
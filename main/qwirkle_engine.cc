@@ -0,0 +1,316 @@
+// A line-based engine protocol over stdin/stdout, in the spirit of UCI in
+// chess, for programs which need many "best move for this board and rack"
+// queries answered without starting a process (or parsing a rendered board)
+// for each one.  The engine keeps its threads, move cache and transposition
+// table from one query to the next.
+//
+// Usage: qwirkle_engine [--threads=N]
+//
+// Tiles are written as codes (color * 6 + shape, as in the bench corpus), and
+// a tile on the board as x,y,code.  Commands, one per line:
+//
+//   isready                 Replies "readyok".
+//   newgame                 Empties the board and rack, and forgets what
+//                           earlier searches found.
+//   position [x,y,code ...] Replaces the board with the given tiles.
+//   place x,y,code ...      Adds tiles to the board.
+//   rack [code,code,...]    Replaces the rack (at most 6 tiles).
+//   load FILE [PLAYER]      Replaces the board, and the rack with player
+//                           PLAYER's (0 by default), from a snapshot saved by
+//                           qwirkle (see snapshot.h).
+//   go [top N] [movetime MS]
+//                           Searches the board and rack.  Prints
+//                           "info ..." with what the search cost, then with
+//                           "top N" a "move <rank> <score> <tiles...>" line
+//                           for each of the N highest scoring moves, highest
+//                           first.  Ends with "bestmove <score> <tiles...>",
+//                           or "bestmove none" if no move is possible.  Moves
+//                           scoring 0 (one tile on an empty board) are never
+//                           listed or chosen.  With movetime the search for
+//                           the best move stops after that many milliseconds
+//                           (top N lists are always complete).
+//   print                   Prints the board and rack for a person.
+//   quit                    Exits.
+//
+// Every reply ends with a newline and is flushed.  A command which can't be
+// carried out replies "error <reason>" and leaves the engine's state as it
+// was.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boardstate.h"
+#include "bag.h"
+#include "rack.h"
+#include "search.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+// Parses a tile code.  Returns false if it isn't a number in [0, 36).
+bool parseCode(const std::string& text, int* code) {
+  char* end;
+  long value = std::strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || value < 0 || value >= Tile::kNumCodes) {
+    return false;
+  }
+  *code = value;
+  return true;
+}
+
+// Parses a comma separated list of tile codes (an empty string is no tiles).
+bool parseTiles(const std::string& text, std::vector<Tile>* tiles) {
+  std::istringstream fields(text);
+  std::string field;
+  while (std::getline(fields, field, ',')) {
+    int code;
+    if (!parseCode(field, &code)) {
+      return false;
+    }
+    tiles->push_back(Tile::fromCode(code));
+  }
+  return true;
+}
+
+// Parses a tile on the board, x,y,code.
+bool parsePlacement(const std::string& text, Placement* placement) {
+  std::istringstream fields(text);
+  std::string x, y, code;
+  if (!std::getline(fields, x, ',') || !std::getline(fields, y, ',') ||
+      !std::getline(fields, code)) {
+    return false;
+  }
+  char* x_end;
+  char* y_end;
+  long px = std::strtol(x.c_str(), &x_end, 10);
+  long py = std::strtol(y.c_str(), &y_end, 10);
+  int tile_code;
+  if (x.empty() || *x_end != '\0' || y.empty() || *y_end != '\0' ||
+      std::abs(px) > 255 || std::abs(py) > 255 ||
+      !parseCode(code, &tile_code)) {
+    return false;
+  }
+  *placement = Placement(Tile::fromCode(tile_code), px, py);
+  return true;
+}
+
+// Writes the move's score and tiles, in the form parsePlacement() reads.
+void printMove(std::ostream& out, const Move& move) {
+  out << move.score;
+  for (int i = 0; i < move.num_tiles; i++) {
+    const Placement& p = move.tiles[i];
+    out << " " << p.x << "," << p.y << "," << p.tile.code();
+  }
+}
+
+class Engine {
+ public:
+  explicit Engine(int num_threads) :
+    pool_(num_threads), table_(18), rack_(nullptr, std::vector<Tile>()),
+    top_moves_(0) {}
+
+  // Carries out one command, writing its reply to out.  Returns false once the
+  // engine should exit.
+  bool handle(const std::string& line, std::ostream& out) {
+    std::istringstream words(line);
+    std::string command;
+    if (!(words >> command)) {
+      return true;  // Blank lines are ignored
+    }
+
+    if (command == "quit") {
+      return false;
+    } else if (command == "isready") {
+      out << "readyok" << std::endl;
+    } else if (command == "newgame") {
+      board_ = BoardState();
+      rack_ = Rack(nullptr, std::vector<Tile>());
+      cache_ = MoveCache();
+      table_.clear();
+    } else if (command == "position") {
+      BoardState board;
+      if (addTiles(&words, &board, out)) {
+	board_ = board;
+      }
+    } else if (command == "place") {
+      BoardState board = board_;
+      if (addTiles(&words, &board, out)) {
+	board_ = board;
+      }
+    } else if (command == "rack") {
+      std::string text;
+      words >> text;
+      std::vector<Tile> tiles;
+      if (!parseTiles(text, &tiles)) {
+	out << "error bad tiles " << text << std::endl;
+      } else if (tiles.size() > size_t(Rack::kMaxTiles)) {
+	out << "error a rack holds at most " << Rack::kMaxTiles << " tiles"
+	    << std::endl;
+      } else {
+	rack_ = Rack(nullptr, tiles);
+      }
+    } else if (command == "load") {
+      std::string path;
+      int player = 0;
+      words >> path;
+      if (!(words >> player)) {
+	player = 0;
+      }
+      // Snapshots given to the engine may come from other programs, so are
+      // verified square by square.
+      BoardState board;
+      Bag bag(0);
+      Rack racks[2] = {Rack(nullptr, std::vector<Tile>()),
+		       Rack(nullptr, std::vector<Tile>())};
+      int scores[2];
+      if (player != 0 && player != 1) {
+	out << "error no player " << player << std::endl;
+      } else if (!loadSnapshot(path, &board, &racks[0], &racks[1], &bag,
+			       &scores[0], &scores[1], true)) {
+	out << "error can't load a snapshot from " << path << std::endl;
+      } else if (checkBoard(board, out)) {
+	board_ = board;
+	rack_ = racks[player];
+      }
+    } else if (command == "go") {
+      go(&words, out);
+    } else if (command == "print") {
+      board_.print(out);
+      rack_.print(out);
+    } else {
+      out << "error unknown command " << command << std::endl;
+    }
+    return true;
+  }
+
+ private:
+  // Adds the tiles listed in words to board, which must stay valid.  Replies
+  // with an error and returns false if it doesn't.
+  bool addTiles(std::istringstream* words, BoardState* board,
+		std::ostream& out) {
+    std::string text;
+    while (*words >> text) {
+      Placement p;
+      if (!parsePlacement(text, &p)) {
+	out << "error bad tile " << text << std::endl;
+	return false;
+      }
+      if ((board->minX() != board->maxX() && !board->isEmpty(p.x, p.y)) ||
+	  !board->canHold(p.x, p.y)) {
+	out << "error can't place a tile at " << p.x << "," << p.y
+	    << std::endl;
+	return false;
+      }
+      board->insertTile(p.tile, p.x, p.y);
+    }
+    return checkBoard(*board, out);
+  }
+
+  // Checks that board could be searched: its lines are valid, and the grid
+  // has room past its tiles for a whole rack to be played in any direction.
+  // Replies with an error and returns false if not.
+  bool checkBoard(const BoardState& board, std::ostream& out) {
+    if (!board.isValidBoard()) {
+      out << "error the board has an invalid line" << std::endl;
+      return false;
+    }
+    const int kMaxSpan = BoardState::kSize - 2 - Rack::kMaxTiles;
+    if (board.maxX() - board.minX() > kMaxSpan ||
+	board.maxY() - board.minY() > kMaxSpan) {
+      out << "error the board is more than " << kMaxSpan
+	  << " squares across" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void go(std::istringstream* words, std::ostream& out) {
+    int top = 0;
+    int move_time_ms = 0;
+    std::string option;
+    while (*words >> option) {
+      bool ok;
+      if (option == "top") {
+	ok = (*words >> top) && top >= 0;
+      } else if (option == "movetime") {
+	ok = (*words >> move_time_ms) && move_time_ms >= 0;
+      } else {
+	ok = false;
+      }
+      if (!ok) {
+	out << "error bad go option " << option << std::endl;
+	return;
+      }
+    }
+
+    StatsTimer timer;
+    Deadline deadline = (move_time_ms > 0) ?
+      Deadline::after(move_time_ms) : Deadline();
+    bool finished;
+    Move best_move = findBestMove(board_, rack_, &pool_, &cache_, &table_,
+				  deadline, &finished);
+    moves_.clear();
+    if (top > 0) {
+      // Moves which score the same are listed in search order, as
+      // MonteCarlo's candidates are.  Moves scoring nothing (a single tile on
+      // an empty board) aren't listed, since the search never plays them.
+      BoardState board = board_;
+      Rack rack = rack_;
+      top_moves_.clear(top);
+      forEachMove(&board, &rack, [this](const Move& move) {
+	  if (move.score > 0) {
+	    top_moves_.add(move);
+	  }
+	});
+      top_moves_.sorted(&moves_);
+    }
+    SearchCounters counters = timer.counters();
+    out << "info nodes " << counters.nodes
+	<< " time_us " << long(1e6 * timer.seconds())
+	<< " finished " << (finished ? 1 : 0) << std::endl;
+    for (size_t i = 0; i < moves_.size(); i++) {
+      out << "move " << i + 1 << " ";
+      printMove(out, moves_[i]);
+      out << std::endl;
+    }
+    if (best_move.num_tiles == 0) {
+      out << "bestmove none" << std::endl;
+    } else {
+      out << "bestmove ";
+      printMove(out, best_move);
+      out << std::endl;
+    }
+  }
+
+  WorkStealingPool pool_;
+  MoveCache cache_;
+  TranspositionTable table_;
+  BoardState board_;
+  Rack rack_;
+  TopMoves top_moves_;       // Kept to reuse their storage
+  std::vector<Move> moves_;
+};
+
+int main(int argc, char** argv) {
+  int num_threads = 1;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 10, "--threads=") == 0) {
+      num_threads = std::max(1, std::atoi(arg.c_str() + 10));
+    } else {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  Engine engine(num_threads);
+  std::string line;
+  while (std::getline(std::cin, line) && engine.handle(line, std::cout)) {
+  }
+  return 0;
+}
@@ -0,0 +1,395 @@
+// Replays the games in binary game logs (see game_log.h), as written by
+// qwirkle --log or qwirkle_sim --log.  Logs are memory-mapped and read in
+// place, so millions of games can be gone through without parsing text.
+//
+// Usage: qwirkle_replay [--threads=N] [--analyze] [--print=N] FILE...
+//
+// Every game is replayed move by move and checked: each tile played or
+// returned was on the player's rack, each move is legal (its tiles fill one
+// line without gaps, touch the tiles already played, and make no invalid
+// line) and scores what the log says, no tile is drawn more often than the bag
+// holds it, and the final scores add up.  The report gives the number of
+// games, turns and bad games (the first few bad games are described on
+// stderr).  --analyze also runs the current engine on every position before
+// a turn and reports how often it agrees with the move that was played, and
+// how many points it finds that the game missed.  --print prints game N
+// (counting from 0 across all the files) turn by turn.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "boardstate.h"
+#include "game_log.h"
+#include "rack.h"
+#include "search.h"
+#include "thread_pool.h"
+
+// The number of bad games described on stderr.
+const int kMaxErrorsShown = 10;
+
+struct ReplayResult {
+  ReplayResult() :
+    turns(0), positions(0), same_move(0), same_score(0), points_missed(0) {}
+
+  std::string error;  // Empty if the game replayed correctly
+  int turns;
+
+  // Only counted with --analyze.
+  long positions;      // Turns on which the engine was asked for a move
+  long same_move;      // Of those, turns on which it chose the move played
+  long same_score;     // And on which its move scored the same
+  long points_missed;  // Total points its moves scored over the moves played
+};
+
+// Returns the squares and tiles of move, sorted, so that moves placing the
+// same tiles in a different order compare equal.
+std::vector<std::pair<std::pair<int, int>, int>> squaresOf(const Move& move) {
+  std::vector<std::pair<std::pair<int, int>, int>> squares;
+  for (int i = 0; i < move.num_tiles; i++) {
+    const Placement& p = move.tiles[i];
+    squares.push_back(std::make_pair(std::make_pair(p.x, p.y),
+				     p.tile.code()));
+  }
+  std::sort(squares.begin(), squares.end());
+  return squares;
+}
+
+// The number of copies of each tile in the game.
+const int kCopiesOfTile = 3;
+
+// Plays a logged turn out on board and rack.  drawn counts the copies of each
+// tile out of the bag, and is kept up to date.  Returns an empty string on
+// success, or what is wrong with the turn.
+std::string playTurn(const LoggedTurn& turn, BoardState* board, Rack* rack,
+		     int* drawn) {
+  std::ostringstream error;
+  if (turn.exchange) {
+    for (int i = 0; i < turn.num_tiles; i++) {
+      if (rack->count(turn.tiles[i].tile) == 0) {
+	error << "returned tile " << turn.tiles[i].tile.code()
+	      << " isn't on the rack";
+	return error.str();
+      }
+      rack->removeTile(turn.tiles[i].tile);
+      drawn[turn.tiles[i].tile.code()]--;
+    }
+    if (turn.score != 0) {
+      return "an exchange scored points";
+    }
+  } else {
+    // The tiles must all go in one row or one column, and (unless the board is
+    // empty) at least one of them must touch a tile already played.
+    bool same_row = true;
+    bool same_column = true;
+    bool touches = (board->minX() == board->maxX());
+    for (int i = 0; i < turn.num_tiles; i++) {
+      const Placement& p = turn.tiles[i];
+      same_row = same_row && p.y == turn.tiles[0].y;
+      same_column = same_column && p.x == turn.tiles[0].x;
+      if (board->canHold(p.x, p.y) && board->isAdjacent(p.x, p.y)) {
+	touches = true;
+      }
+    }
+    if (!same_row && !same_column) {
+      return "tiles aren't all in one row or column";
+    }
+    if (!touches) {
+      return "move doesn't touch the tiles already played";
+    }
+
+    Move move;
+    for (int i = 0; i < turn.num_tiles; i++) {
+      const Placement& p = turn.tiles[i];
+      if (rack->count(p.tile) == 0) {
+	error << "tile " << p.tile.code() << " isn't on the rack";
+	return error.str();
+      }
+      if (!board->isEmpty(p.x, p.y) || !board->canHold(p.x, p.y)) {
+	error << "can't place a tile at " << p.x << "," << p.y;
+	return error.str();
+      }
+      rack->removeTile(p.tile);
+      board->insertTile(p.tile, p.x, p.y);
+      move.push(p.tile, p.x, p.y);
+      if (!board->isValidAfterPlacing(p.x, p.y)) {
+	error << "tile at " << p.x << "," << p.y << " makes an invalid line";
+	return error.str();
+      }
+    }
+    move.horiz = same_row;
+
+    // Every square between the first and last tiles must now be filled, by
+    // the move or by tiles already played.
+    for (int i = 1; i < move.num_tiles; i++) {
+      const Placement& first = move.tiles[0];
+      const Placement& p = move.tiles[i];
+      int dx = (p.x > first.x) - (p.x < first.x);
+      int dy = (p.y > first.y) - (p.y < first.y);
+      for (int x = first.x + dx, y = first.y + dy; x != p.x || y != p.y;
+	   x += dx, y += dy) {
+	if (board->isEmpty(x, y)) {
+	  error << "gap at " << x << "," << y << " in the move";
+	  return error.str();
+	}
+      }
+    }
+
+    // A first move of one tile scores 1, as in the interactive game.
+    int score = std::max(move.num_tiles > 0 ? 1 : 0, scoreMove(*board, move));
+    if (score != turn.score) {
+      error << "move scores " << score << ", not " << turn.score;
+      return error.str();
+    }
+  }
+
+  if (rack->size() + turn.num_drawn > size_t(Rack::kMaxTiles)) {
+    return "drew more tiles than the rack holds";
+  }
+  for (int i = 0; i < turn.num_drawn; i++) {
+    if (++drawn[turn.drawn[i]] > kCopiesOfTile) {
+      error << "drew a copy of tile " << int(turn.drawn[i])
+	    << " the bag doesn't have";
+      return error.str();
+    }
+    rack->addTile(Tile::fromCode(turn.drawn[i]));
+  }
+  return "";
+}
+
+// Replays game, checking it as it goes, and with analyze asks the engine for
+// its move before every turn.
+ReplayResult replayGame(const LoggedGame& game, bool analyze) {
+  ReplayResult result;
+  BoardState board;
+  Rack racks[2] = {Rack(nullptr, game.startingRack(0)),
+		   Rack(nullptr, game.startingRack(1))};
+  int scores[2] = {0, 0};
+  int drawn[Tile::kNumCodes] = {0};
+  for (int player = 0; player < 2; player++) {
+    std::vector<Tile> tiles = game.startingRack(player);
+    for (auto t = tiles.begin(); t != tiles.end(); t++) {
+      if (++drawn[t->code()] > kCopiesOfTile) {
+	result.error = "more copies of tile " + std::to_string(t->code()) +
+	  " in the starting racks than the bag has";
+	return result;
+      }
+    }
+  }
+  size_t offset = kGameHeaderSize;
+  LoggedTurn turn;
+  for (; result.turns < game.numTurns(); result.turns++) {
+    if (!game.nextTurn(&offset, &turn)) {
+      result.error = "turn " + std::to_string(result.turns) + ": unreadable";
+      return result;
+    }
+
+    if (analyze) {
+      Move best = greedyMove(&board, &racks[turn.player]);
+      result.positions++;
+      if (best.score == turn.score) {
+	result.same_score++;
+      }
+      if (!turn.exchange) {
+	Move played;
+	for (int i = 0; i < turn.num_tiles; i++) {
+	  played.push(turn.tiles[i].tile, turn.tiles[i].x, turn.tiles[i].y);
+	}
+	if (squaresOf(best) == squaresOf(played)) {
+	  result.same_move++;
+	}
+      } else if (best.num_tiles == 0) {
+	result.same_move++;
+      }
+      result.points_missed += std::max(0, best.score - turn.score);
+    }
+
+    std::string error = playTurn(turn, &board, &racks[turn.player], drawn);
+    if (!error.empty()) {
+      result.error = "turn " + std::to_string(result.turns) + ": " + error;
+      return result;
+    }
+    scores[turn.player] += turn.score;
+  }
+
+  if (offset != game.size()) {
+    result.error = "more turns than the header says";
+    return result;
+  }
+  for (int player = 0; player < 2; player++) {
+    int bonus = game.score(player) - scores[player];
+    if (bonus != 0 && bonus != kGoOutBonus) {
+      std::ostringstream error;
+      error << "player " << player << "'s moves add up to " << scores[player]
+	    << ", not " << game.score(player);
+      result.error = error.str();
+      return result;
+    }
+  }
+  return result;
+}
+
+// Prints game turn by turn, and the final board.
+void printGame(const LoggedGame& game) {
+  std::cout << "seed " << game.seed() << ", " << game.numTurns()
+	    << " turns, final score " << game.score(0) << " to "
+	    << game.score(1) << std::endl;
+  for (int player = 0; player < 2; player++) {
+    std::cout << "player " << player << " starts with";
+    std::vector<Tile> tiles = game.startingRack(player);
+    for (auto t = tiles.begin(); t != tiles.end(); t++) {
+      std::cout << " " << t->code();
+    }
+    std::cout << std::endl;
+  }
+
+  BoardState board;
+  size_t offset = kGameHeaderSize;
+  LoggedTurn turn;
+  for (int t = 0; t < game.numTurns() && game.nextTurn(&offset, &turn); t++) {
+    std::cout << "turn " << t << ": player " << turn.player;
+    if (turn.exchange) {
+      std::cout << " returns";
+      for (int i = 0; i < turn.num_tiles; i++) {
+	std::cout << " " << turn.tiles[i].tile.code();
+      }
+    } else {
+      std::cout << " scores " << turn.score << " with";
+      for (int i = 0; i < turn.num_tiles; i++) {
+	const Placement& p = turn.tiles[i];
+	std::cout << " " << p.x << "," << p.y << "," << p.tile.code();
+	if (board.isEmpty(p.x, p.y) && board.canHold(p.x, p.y)) {
+	  board.insertTile(p.tile, p.x, p.y);
+	}
+      }
+    }
+    std::cout << ", draws";
+    for (int i = 0; i < turn.num_drawn; i++) {
+      std::cout << " " << int(turn.drawn[i]);
+    }
+    std::cout << std::endl;
+  }
+  board.print();
+  std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+  int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  bool analyze = false;
+  long print_game = -1;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 10, "--threads=") == 0) {
+      num_threads = std::max(1, std::atoi(arg.c_str() + 10));
+    } else if (arg == "--analyze") {
+      analyze = true;
+    } else if (arg.compare(0, 8, "--print=") == 0) {
+      print_game = std::atol(arg.c_str() + 8);
+    } else if (arg.compare(0, 2, "--") == 0) {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return 1;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty()) {
+    std::cerr << "No game logs given" << std::endl;
+    return 1;
+  }
+
+  // The logs stay mapped while their games are replayed.
+  std::vector<std::unique_ptr<GameLogReader>> logs;
+  std::vector<LoggedGame> games;
+  size_t total_bytes = 0;
+  for (auto path = paths.begin(); path != paths.end(); path++) {
+    logs.push_back(
+      std::unique_ptr<GameLogReader>(new GameLogReader(*path)));
+    GameLogReader* log = logs.back().get();
+    if (!log->ok()) {
+      std::cerr << "Can't read " << *path << std::endl;
+      return 1;
+    }
+    LoggedGame game;
+    while (log->next(&game)) {
+      games.push_back(game);
+    }
+    if (log->corrupt()) {
+      std::cerr << *path << ": stopped at a bad record after "
+		<< games.size() << " games" << std::endl;
+    }
+    total_bytes += log->size();
+  }
+
+  if (print_game >= 0) {
+    if (print_game >= long(games.size())) {
+      std::cerr << "There are only " << games.size() << " games" << std::endl;
+      return 1;
+    }
+    printGame(games[print_game]);
+    return 0;
+  }
+
+  WorkStealingPool pool(num_threads);
+  std::vector<ReplayResult> results(games.size());
+  auto start = std::chrono::steady_clock::now();
+  pool.parallelFor(games.size(),
+		   [&](int, int i) {
+		     results[i] = replayGame(games[i], analyze);
+		   });
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  long total_turns = 0;
+  long bad_games = 0;
+  long positions = 0;
+  long same_move = 0;
+  long same_score = 0;
+  long points_missed = 0;
+  double score_sum = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    const ReplayResult& r = results[i];
+    total_turns += r.turns;
+    positions += r.positions;
+    same_move += r.same_move;
+    same_score += r.same_score;
+    points_missed += r.points_missed;
+    score_sum += games[i].score(0) + games[i].score(1);
+    if (!r.error.empty()) {
+      if (bad_games < kMaxErrorsShown) {
+	std::cerr << "game " << i << ": " << r.error << std::endl;
+      }
+      bad_games++;
+    }
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "games:          " << games.size() << " (" << total_bytes
+	    << " bytes, " << num_threads << " threads)" << std::endl;
+  std::cout << "wall time:      " << elapsed.count() << " s" << std::endl;
+  std::cout << "throughput:     " << games.size() / elapsed.count()
+	    << " games/s, " << total_turns / elapsed.count() << " turns/s"
+	    << std::endl;
+  std::cout << "bad games:      " << bad_games << std::endl;
+  if (!games.empty()) {
+    std::cout << "score:          mean " << score_sum / (2 * games.size())
+	      << std::endl;
+  }
+  if (analyze && positions > 0) {
+    std::cout << "engine agrees:  " << 100.0 * same_move / positions
+	      << "% same move, " << 100.0 * same_score / positions
+	      << "% same score" << std::endl;
+    std::cout << "points missed:  " << double(points_missed) / positions
+	      << " per turn" << std::endl;
+  }
+
+  return bad_games == 0 ? 0 : 1;
+}
@@ -0,0 +1,413 @@
+// Headless self-play: the computer plays complete games against itself, with no
+// terminal I/O, and reports throughput, turn latency and score statistics.
+// This is the main tool for load-testing and tuning the engine.
+//
+// Usage: qwirkle_sim [--games=N] [--threads=N] [--seed=N] [--move_time_ms=N]
+//                    [--endgame_nodes=N] [--strategy=NAME[,NAME]]
+//                    [--stats[=json]] [--log=FILE]
+//
+// Games are spread across --threads worker threads (one game per worker at a
+// time, each searching single-threaded).  Results depend only on --seed, not on
+// the number of threads.  With --move_time_ms each search has that long to
+// find a move; results then depend on timing too.  --endgame_nodes=N searches
+// the rest of the game once the bag is empty, up to N positions a turn
+// (qwirkle uses 2000).  It's off by default, as at 2000 the average turn
+// takes about 50 times as long, and endgame turns up to tens of milliseconds.
+// --strategy is how the players choose their moves before then: greedy (the
+// default) or montecarlo, for both players or (with two names) for the first
+// and second player.  --stats adds the search's work per turn to the report;
+// --stats=json instead prints one JSON object per turn (with its game, turn
+// and player) before the report.
+// --log appends a record of every game to FILE (see game_log.h), in the order
+// the games finish.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bag.h"
+#include "boardstate.h"
+#include "game_log.h"
+#include "player.h"
+#include "rack.h"
+#include "random.h"
+#include "search.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+// A game is abandoned if it runs for this many turns.  Real games are far
+// shorter; this just guarantees termination.
+const int kMaxTurns = 1000;
+
+struct GameResult {
+  GameResult() :
+    scores{0, 0}, turns(0), out_of_time(0), node_limited(0),
+    search_seconds(0) {}
+
+  int scores[2];
+  int turns;
+  int out_of_time;   // Turns whose search ran out of time
+  int node_limited;  // Endgame turns whose search stopped at its node limit
+  double search_seconds;
+  SearchCounters counters;            // Work done by every turn's search
+  std::vector<TurnStats> turn_stats;  // Only kept for --stats=json
+  std::vector<uint8_t> record;        // Only kept for --log
+};
+
+// How the games are played.
+struct SimOptions {
+  SimOptions() : move_time_ms(0),
+		 endgame_nodes(0),
+		 montecarlo{false, false}, keep_turn_stats(false),
+		 keep_record(false) {}
+
+  int move_time_ms;    // Time for each search, 0 for as long as it needs
+  long endgame_nodes;  // Size of each endgame search, 0 for none
+  bool montecarlo[2];  // Whether each player uses a MonteCarlo search
+  bool keep_turn_stats;  // Whether to keep each turn's TurnStats
+  bool keep_record;      // Whether to keep a GameRecorder record of the game
+};
+
+// Plays one computer-vs-computer game, drawing tiles from a bag made from
+// seed, and making any random choices in the players' searches with
+// strategy_random.  Player 0 moves first.  As in the interactive game,
+// the first player to empty their rack once the bag is empty gets a 6 point
+// bonus and ends the game.  The game also ends if neither player can move and
+// the bag is empty.  The time taken by each turn is appended to turn_seconds.
+// table is shared by every game.
+GameResult playGame(uint64_t seed,
+		    Random strategy_random,
+		    WorkStealingPool* search_pool,
+		    TranspositionTable* table,
+		    const SimOptions& options,
+		    std::vector<float>* turn_seconds) {
+  GameResult result;
+  BoardState board;
+  Bag bag(seed);
+  Rack rack0(&bag);
+  Rack rack1(&bag);
+  Rack* racks[2] = {&rack0, &rack1};
+  std::unique_ptr<GameRecorder> recorder;
+  if (options.keep_record) {
+    recorder.reset(new GameRecorder(seed, rack0, rack1));
+  }
+  MoveCache caches[2];
+  // Endgame searches get a table of their own, as what they find depends on
+  // what earlier searches left in it, and results shouldn't depend on which
+  // games share a thread.
+  TranspositionTable endgame_table(15);
+  EndgameSolver endgame(&endgame_table, options.endgame_nodes);
+  std::vector<MonteCarlo> montecarlos;
+  std::vector<ComputerPlayer> players;
+  for (int player = 0; player < 2; player++) {
+    montecarlos.push_back(MonteCarlo(strategy_random.next(),
+				     MonteCarlo::kDefaultCandidates,
+				     MonteCarlo::kDefaultSamples,
+				     MonteCarlo::kDefaultTurns));
+  }
+  for (int player = 0; player < 2; player++) {
+    players.push_back(ComputerPlayer(search_pool));
+    players[player].cache = &caches[player];
+    players[player].table = table;
+    if (options.endgame_nodes > 0) {
+      players[player].endgame = &endgame;
+    }
+    if (options.montecarlo[player]) {
+      players[player].montecarlo = &montecarlos[player];
+    }
+  }
+  int passes = 0;
+
+  for (int player = 0; result.turns < kMaxTurns; player = 1 - player) {
+    TurnStats stats;
+    stats.board_tiles = Bag::kNumTiles - bag.tiles_left() - rack0.size() -
+      rack1.size();
+    stats.board_width = board.maxX() - board.minX();
+    stats.board_height = board.maxY() - board.minY();
+    StatsTimer timer;
+    Deadline deadline = (options.move_time_ms > 0) ?
+      Deadline::after(options.move_time_ms) : Deadline();
+    bool finished;
+    Rack before = *racks[player];
+    Move move = computerTurn(&board, racks[player], &result.scores[player],
+			     players[player], deadline, &finished);
+    if (recorder) {
+      if (move.num_tiles > 0) {
+	recorder->move(player, move, before, *racks[player]);
+      } else {
+	recorder->exchange(player, before.getTiles(), before, *racks[player]);
+      }
+    }
+    stats.counters = timer.counters();
+    stats.seconds = timer.seconds();
+    result.search_seconds += stats.seconds;
+    result.counters += stats.counters;
+    turn_seconds->push_back(stats.seconds);
+    if (options.keep_turn_stats) {
+      result.turn_stats.push_back(stats);
+    }
+    result.turns++;
+    // Without a deadline, only the endgame's node limit stops a search early.
+    if (!finished && deadline.hasPassed()) {
+      result.out_of_time++;
+    } else if (!finished) {
+      result.node_limited++;
+    }
+
+    if (racks[player]->size() == 0) {
+      result.scores[player] += kGoOutBonus;
+      break;
+    }
+    passes = (move.score > 0) ? 0 : passes + 1;
+    if (passes >= 2 && bag.tiles_left() == 0) {
+      break;
+    }
+  }
+  if (recorder) {
+    result.record = recorder->finish(result.scores[0], result.scores[1]);
+  }
+  return result;
+}
+
+// Returns the p'th percentile (p in [0,1]) of the sorted values.
+template <typename T>
+T percentile(const std::vector<T>& sorted, double p) {
+  if (sorted.empty()) {
+    return T();
+  }
+  size_t i = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+  return sorted[i];
+}
+
+// Sets *montecarlo to whether name is the montecarlo strategy.  Returns false
+// if it isn't a strategy at all.
+bool parseStrategy(const std::string& name, bool* montecarlo) {
+  *montecarlo = (name == "montecarlo");
+  return name == "montecarlo" || name == "greedy";
+}
+
+int main(int argc, char** argv) {
+  int num_games = 100;
+  int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  SimOptions options;
+  std::string strategies[2] = {"greedy", "greedy"};
+  std::string stats_format;  // Empty for no --stats
+  std::string log_path;      // Empty for no --log
+  uint64_t seed = std::time(0);
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 8, "--games=") == 0) {
+      num_games = std::max(1, std::atoi(arg.c_str() + 8));
+    } else if (arg.compare(0, 10, "--threads=") == 0) {
+      num_threads = std::max(1, std::atoi(arg.c_str() + 10));
+    } else if (arg.compare(0, 7, "--seed=") == 0) {
+      seed = std::strtoull(arg.c_str() + 7, nullptr, 10);
+    } else if (arg.compare(0, 15, "--move_time_ms=") == 0) {
+      options.move_time_ms = std::max(0, std::atoi(arg.c_str() + 15));
+    } else if (arg.compare(0, 16, "--endgame_nodes=") == 0) {
+      options.endgame_nodes = std::max(0L, std::atol(arg.c_str() + 16));
+    } else if (arg.compare(0, 11, "--strategy=") == 0) {
+      std::string names = arg.substr(11);
+      size_t comma = names.find(',');
+      strategies[0] = names.substr(0, comma);
+      strategies[1] = (comma == std::string::npos) ?
+	strategies[0] : names.substr(comma + 1);
+    } else if (arg == "--stats" || arg == "--stats=text") {
+      stats_format = "text";
+    } else if (arg == "--stats=json") {
+      stats_format = "json";
+    } else if (arg.compare(0, 6, "--log=") == 0) {
+      log_path = arg.substr(6);
+    } else {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return 1;
+    }
+  }
+  for (int player = 0; player < 2; player++) {
+    if (!parseStrategy(strategies[player], &options.montecarlo[player])) {
+      std::cerr << "Unknown strategy " << strategies[player] << std::endl;
+      return 1;
+    }
+  }
+  options.keep_turn_stats = (stats_format == "json");
+  options.keep_record = !log_path.empty();
+  std::unique_ptr<GameLogWriter> log;
+  if (!log_path.empty()) {
+    log.reset(new GameLogWriter(log_path));
+    if (!log->ok()) {
+      std::cerr << "Can't open " << log_path << std::endl;
+      return 1;
+    }
+  }
+  if (!stats_format.empty() && !kSearchStats) {
+    std::cerr << "Built with NO_SEARCH_STATS: only nodes are counted."
+	      << std::endl;
+  }
+
+  // Each game gets its own seed, so a game plays out the same way whichever
+  // thread it runs on.  The players' searches get a
+  // separate generator, so that the tiles drawn don't depend on the
+  // strategies.
+  Random random(seed);
+  Random strategy_random(~seed);
+  std::vector<uint64_t> game_seeds;
+  std::vector<Random> strategy_randoms;
+  for (int i = 0; i < num_games; i++) {
+    game_seeds.push_back(random.next());
+    strategy_randoms.push_back(strategy_random.split());
+  }
+
+  WorkStealingPool game_pool(num_threads);
+  // Each game searches single-threaded, on its worker's own (thread-less)
+  // pool.
+  std::vector<std::unique_ptr<WorkStealingPool>> search_pools;
+  std::vector<std::vector<float>> turn_seconds(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    search_pools.push_back(
+      std::unique_ptr<WorkStealingPool>(new WorkStealingPool(1)));
+  }
+
+  TranspositionTable table(18);
+  std::vector<GameResult> results(num_games);
+  std::mutex log_mu;
+  bool log_failed = false;
+  auto start = std::chrono::steady_clock::now();
+  game_pool.parallelFor(num_games,
+			[&](int worker, int i) {
+			  results[i] = playGame(game_seeds[i],
+						strategy_randoms[i],
+						search_pools[worker].get(),
+						&table, options,
+						&turn_seconds[worker]);
+			  if (log) {
+			    std::lock_guard<std::mutex> lock(log_mu);
+			    if (!log->append(results[i].record)) {
+			      log_failed = true;
+			    }
+			    results[i].record.clear();
+			    results[i].record.shrink_to_fit();
+			  }
+			});
+  if (log_failed) {
+    std::cerr << "Error writing " << log_path << std::endl;
+    return 1;
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  long total_turns = 0;
+  long out_of_time = 0;
+  long node_limited = 0;
+  SearchCounters counters;
+  int first_player_wins = 0;
+  int draws = 0;
+  std::vector<int> scores;
+  std::vector<int> margins;
+  for (auto r = results.begin(); r != results.end(); r++) {
+    total_turns += r->turns;
+    out_of_time += r->out_of_time;
+    node_limited += r->node_limited;
+    counters += r->counters;
+    scores.push_back(r->scores[0]);
+    scores.push_back(r->scores[1]);
+    margins.push_back(std::abs(r->scores[0] - r->scores[1]));
+    if (r->scores[0] > r->scores[1]) {
+      first_player_wins++;
+    } else if (r->scores[0] == r->scores[1]) {
+      draws++;
+    }
+  }
+  std::vector<float> latencies;
+  for (auto t = turn_seconds.begin(); t != turn_seconds.end(); t++) {
+    latencies.insert(latencies.end(), t->begin(), t->end());
+  }
+  std::sort(scores.begin(), scores.end());
+  std::sort(margins.begin(), margins.end());
+  std::sort(latencies.begin(), latencies.end());
+
+  double score_sum = 0;
+  for (auto s = scores.begin(); s != scores.end(); s++) {
+    score_sum += *s;
+  }
+  double score_mean = score_sum / scores.size();
+  double score_var = 0;
+  for (auto s = scores.begin(); s != scores.end(); s++) {
+    score_var += (*s - score_mean) * (*s - score_mean);
+  }
+  double latency_sum = 0;
+  for (auto l = latencies.begin(); l != latencies.end(); l++) {
+    latency_sum += *l;
+  }
+
+  if (stats_format == "json") {
+    for (int i = 0; i < num_games; i++) {
+      const std::vector<TurnStats>& turns = results[i].turn_stats;
+      for (size_t turn = 0; turn < turns.size(); turn++) {
+	std::cout << "{\"game\":" << i << ",\"turn\":" << turn
+		  << ",\"player\":" << turn % 2 << ",";
+	turns[turn].printJson(std::cout);
+	std::cout << "}" << std::endl;
+      }
+    }
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "games:          " << num_games << " (seed " << seed << ", "
+	    << num_threads << " threads)" << std::endl;
+  std::cout << "players:        " << strategies[0] << " vs " << strategies[1]
+	    << std::endl;
+  std::cout << "wall time:      " << elapsed.count() << " s" << std::endl;
+  std::cout << "throughput:     " << num_games / elapsed.count()
+	    << " games/s, " << total_turns / elapsed.count() << " turns/s"
+	    << std::endl;
+  std::cout << "turns/game:     " << double(total_turns) / num_games
+	    << std::endl;
+  std::cout << "turn latency:   mean " << 1e6 * latency_sum / latencies.size()
+	    << " us, p50 " << 1e6 * percentile(latencies, 0.5)
+	    << " us, p99 " << 1e6 * percentile(latencies, 0.99)
+	    << " us, max " << 1e6 * percentile(latencies, 1.0) << " us"
+	    << std::endl;
+  std::cout << "unfinished:     " << out_of_time << " turns out of time ("
+	    << 100.0 * out_of_time / total_turns << "%), " << node_limited
+	    << " at the endgame node limit ("
+	    << 100.0 * node_limited / total_turns << "%)" << std::endl;
+  if (stats_format == "text") {
+    std::cout << "search:         ";
+    printCounters(std::cout, counters);
+    std::cout << std::endl;
+    std::cout << "search/turn:    "
+	      << double(counters.nodes) / total_turns << " nodes, "
+	      << double(counters.board_copies) / total_turns
+	      << " board copies, "
+	      << double(counters.validations) / total_turns << " validations, "
+	      << double(counters.scored_moves) / total_turns
+	      << " moves scored, "
+	      << double(counters.moves_found) / total_turns << " moves found"
+	      << std::endl;
+  }
+  std::cout << "score:          mean " << score_mean
+	    << ", stddev " << std::sqrt(score_var / scores.size())
+	    << ", min " << percentile(scores, 0.0)
+	    << ", p10 " << percentile(scores, 0.1)
+	    << ", p50 " << percentile(scores, 0.5)
+	    << ", p90 " << percentile(scores, 0.9)
+	    << ", max " << percentile(scores, 1.0) << std::endl;
+  std::cout << "winning margin: p50 " << percentile(margins, 0.5)
+	    << ", p90 " << percentile(margins, 0.9)
+	    << ", max " << percentile(margins, 1.0) << std::endl;
+  std::cout << "first player:   " << first_player_wins << " wins, "
+	    << draws << " draws, " << num_games - first_player_wins - draws
+	    << " losses" << std::endl;
+
+  return 0;
+}
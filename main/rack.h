@@ -1,65 +1,143 @@
 #ifndef RACK_H
 #define RACK_H
 
-#include <deque>
+#include <assert.h>
+#include <stdint.h>
+#include <iomanip>
 #include <iostream>
+#include <vector>
 
 #include "bag.h"
+#include "little_endian.h"
+#include "tileset.h"
+#include "zobrist.h"
 
+// A player's rack.  The rack is a multiset of tiles, kept as a count of each of
+// the 36 kinds of tile, so that adding and removing a tile is O(1), racks can
+// be copied freely in the search, and the search can try each kind of tile on
+// the rack once however many copies there are.
 class Rack {
  public:
-  Rack(Bag* pbag) : pbag_(pbag) {
+  static const int kMaxTiles = 6;
+
+  Rack(Bag* pbag) :
+    pbag_(pbag), counts_(), size_(0), tile_set_(0), key_(0) {
     populate();
   }
 
+  // Creates a rack holding the given tiles, for setting up saved positions.
+  Rack(Bag* pbag, const std::vector<Tile>& tiles) :
+    pbag_(pbag), counts_(), size_(0), tile_set_(0), key_(0) {
+    assert(tiles.size() <= size_t(kMaxTiles));
+    for (auto tile = tiles.begin(); tile != tiles.end(); tile++) {
+      addTile(*tile);
+    }
+  }
+
   Bag* bag() const { return pbag_; }
 
   void populate() {
-    while(tiles_.size() < 6 &&
+    while(size_ < kMaxTiles &&
 	  pbag_->tiles_left() > 0) {
-      tiles_.push_back(pbag_->pick_tile());
+      addTile(pbag_->pick_tile());
     }
-    // Just to be nice, sort the rack:
-    std::stable_sort(tiles_.begin(), tiles_.end(),
-		     [](Tile i, Tile j)
-		     {return i.shape() < j.shape();}); 
-    std::stable_sort(tiles_.begin(), tiles_.end(),
-		     [](Tile i, Tile j)
-		     {return i.color() < j.color();}); 
   }
 
+  // Returns the tiles on the rack, sorted (by color, then shape).  This is the
+  // order they are printed and numbered in.
   const std::vector<Tile> getTiles() const {
-    std::vector<Tile> result(tiles_.begin(), tiles_.end());
+    std::vector<Tile> result;
+    for (TileSet set = tile_set_; set != 0; set &= set - 1) {
+      int code = firstTile(set);
+      result.insert(result.end(), counts_[code], Tile::fromCode(code));
+    }
     return result;
   }
 
-  const size_t size() { return tiles_.size(); }
+  const size_t size() { return size_; }
+
+  // The kinds of tile on the rack.
+  TileSet tileSet() const { return tile_set_; }
+
+  // The number of copies of t on the rack.
+  int count(Tile t) const { return counts_[t.code()]; }
+
+  // The XOR of rackTileKey() for every tile on the rack.  Racks holding the
+  // same tiles have the same key, whatever order they were drawn in.
+  uint64_t key() const { return key_; }
+
+  void addTile(Tile t) {
+    assert(size_ < kMaxTiles);
+    int code = t.code();
+    counts_[code]++;
+    key_ ^= rackTileKey(code, counts_[code]);
+    size_++;
+    tile_set_ |= tileBit(code);
+  }
 
+  // Takes one copy of t off the rack, if there is one.
   void removeTile(Tile t) {
-    for (auto tile = tiles_.begin(); tile != tiles_.end(); tile++) {
-      if (*tile == t) {
-	tiles_.erase(tile);
-	break;
+    int code = t.code();
+    if (counts_[code] == 0) {
+      return;
+    }
+    size_--;
+    key_ ^= rackTileKey(code, counts_[code]);
+    if (--counts_[code] == 0) {
+      tile_set_ &= ~tileBit(code);
+    }
+  }
+
+  // A rack's snapshot (see snapshot.h) is its number of tiles and their
+  // codes, sorted, with 0xff for each missing tile.
+  static const int kSnapshotSize = 1 + kMaxTiles;
+
+  void saveSnapshot(uint8_t* out) const {
+    std::vector<Tile> tiles = getTiles();
+    out[0] = size_;
+    for (int i = 0; i < kMaxTiles; i++) {
+      out[1 + i] = (i < size_) ? tiles[i].code() : 0xff;
+    }
+  }
+
+  // Replaces the rack's tiles (but not its bag) with the snapshot's.  Returns
+  // false (leaving the rack unchanged) if the snapshot holds too many tiles or
+  // a tile that doesn't exist.
+  bool loadSnapshot(const uint8_t* in) {
+    int size = in[0];
+    if (size > kMaxTiles) {
+      return false;
+    }
+    std::vector<Tile> tiles;
+    for (int i = 0; i < size; i++) {
+      if (in[1 + i] >= Tile::kNumCodes) {
+	return false;
       }
+      tiles.push_back(Tile::fromCode(in[1 + i]));
     }
+    *this = Rack(pbag_, tiles);
+    return true;
   }
 
-  void print() const {
-    for(auto t = tiles_.begin(); t != tiles_.end(); t++) {
-      std::cout << " ";
-      t->print();
+  void print(std::ostream& out = std::cout) const {
+    std::vector<Tile> tiles = getTiles();
+    for (auto tile = tiles.begin(); tile != tiles.end(); tile++) {
+      out << " ";
+      tile->print(out);
     }
-    std::cout << std::endl;
-    int i=0;
-    for(auto t = tiles_.begin(); t != tiles_.end(); t++, i++) {
-      std::cout << std::setw(2) << i << " ";
+    out << std::endl;
+    for (size_t i = 0; i < tiles.size(); i++) {
+      out << std::setw(2) << i << " ";
     }
-    std::cout << std::endl;
+    out << std::endl;
   }
 
  private:
   Bag* pbag_;
-  std::deque<Tile> tiles_;
+  uint8_t counts_[Tile::kNumCodes];  // Copies of each tile, by code
+  int size_;
+  TileSet tile_set_;  // The tiles with a non-zero count
+  uint64_t key_;
 };
 
 #endif // RACK_H
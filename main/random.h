@@ -0,0 +1,83 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+#include "little_endian.h"
+
+// A small, fast pseudo-random number generator (xoshiro256**).  Each game owns
+// its own generator, so games are reproducible from their seed and parallel
+// games never share random state.
+class Random {
+ public:
+  explicit Random(uint64_t seed) {
+    // Expand the seed into the full state with splitmix64, as recommended by
+    // the xoshiro authors.  This also avoids the all-zero state.
+    for (int i = 0; i < 4; i++) {
+      seed += 0x9e3779b97f4a7c15ULL;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      s_[i] = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t next() {
+    uint64_t result = rotl(s_[1] * 5, 7) * 9;
+    uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 45);
+    return result;
+  }
+
+  // Returns a number in [0, n).  (Multiply-shift rather than modulo; the bias
+  // for the small n used here is negligible.)
+  uint32_t uniform(uint32_t n) {
+    return uint32_t(((next() >> 32) * n) >> 32);
+  }
+
+  // Returns a new generator, independent of this one, for handing to a
+  // sub-task (say, one game of many).
+  Random split() {
+    return Random(next());
+  }
+
+  // A generator's snapshot (see snapshot.h) is its state, so a restored
+  // generator carries on with the same numbers.
+  static const int kSnapshotSize = 32;
+
+  void saveSnapshot(uint8_t* out) const {
+    for (int i = 0; i < 4; i++) {
+      storeLE(out + 8 * i, s_[i], 8);
+    }
+  }
+
+  // Returns false (leaving the generator unchanged) for the all-zero state,
+  // which would only ever produce zeros.
+  bool loadSnapshot(const uint8_t* in) {
+    uint64_t s[4];
+    for (int i = 0; i < 4; i++) {
+      s[i] = loadLE(in + 8 * i, 8);
+    }
+    if ((s[0] | s[1] | s[2] | s[3]) == 0) {
+      return false;
+    }
+    for (int i = 0; i < 4; i++) {
+      s_[i] = s[i];
+    }
+    return true;
+  }
+
+ private:
+  static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  uint64_t s_[4];
+};
+
+#endif // RANDOM_H
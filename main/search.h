@@ -0,0 +1,1300 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+
+#include "bag.h"
+#include "boardstate.h"
+#include "rack.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "tileset.h"
+#include "transposition_table.h"
+
+// One tile of a move, and the square it is placed on.
+struct Placement {
+  Placement() : tile(Tile::red, Tile::circle), x(0), y(0) {}
+  Placement(Tile tile, int x, int y) : tile(tile), x(x), y(y) {}
+
+  Tile tile;
+  int x, y;
+};
+
+// A move: the tiles played (in the order they were placed), whether they were
+// placed horizontally or vertically, and the resulting score.  This is small
+// and fixed-size so that the search can record moves without copying boards.
+struct Move {
+  Move() : num_tiles(0), horiz(true), score(0) {}
+
+  void push(Tile tile, int x, int y) {
+    assert(num_tiles < Rack::kMaxTiles);
+    tiles[num_tiles++] = Placement(tile, x, y);
+  }
+  void pop() {
+    num_tiles--;
+  }
+
+  Placement tiles[Rack::kMaxTiles];
+  int num_tiles;
+  bool horiz;
+  int score;
+};
+
+// Given a board, the location of one tile, and whether that word is horizontal
+// or vertical -- compute the score of playing that specified tile.  The board
+// keeps track of word lengths, so this takes constant time.
+inline int scoreWord(const BoardState& board,
+		     int x, int y,
+		     bool horiz) {
+  int len = board.wordLength(x, y, horiz);
+
+  // If the word is 6 long, then you have a Qwirkle and its score is doubled:
+  return (len == 6) ? 12 : len;
+}
+
+// Compute the score of a move whose tiles have already been placed on the
+// board.  The move has to say whether its tiles are horizontally or vertically
+// aligned (note that this doesn't matter if there is only one tile).
+inline int scoreMove(const BoardState& board,
+		     const Move& move) {
+  COUNT_SEARCH_STAT(scored_moves);
+  int score = 0;
+  bool horiz = move.horiz;
+
+  // First compute the score of the word formed directly by putting down these
+  // tiles.  Can start from any tile in the word, pick the first one
+  // arbitrarily.
+  int primary_score = scoreWord(board,
+				move.tiles[0].x,
+				move.tiles[0].y,
+				horiz);
+  if (primary_score > 1) {
+    // Either this is the first move of the game and a single tile (which will
+    // be handled by the caller), or a single tile was played and it only
+    // generates multi-tile worlds in the other direction (and will be counted
+    // below).
+    score += primary_score;
+  }
+  
+  // For each tile played compute the score of any words formed perpendicular to
+  // the primary word.  Don't count single-tile words.
+  for (int i = 0; i < move.num_tiles; i++) {
+    int secondary_score = scoreWord(board, move.tiles[i].x, move.tiles[i].y,
+				    !horiz);
+    if (secondary_score > 1) {
+      score += secondary_score;
+    }
+  }
+
+  return score;
+}
+
+// The score of a word of the given length, as counted by scoreMove.
+inline int wordScore(int len) {
+  if (len < 2) {
+    return 0;
+  }
+  return (len == 6) ? 12 : len;
+}
+
+// Returns an upper bound on the score of any move which extends move (whose
+// tiles are already on the board, and whose score has been computed) by placing
+// up to num_tiles more tiles from rack_tiles in direction (dx,dy), starting on
+// the empty square (x,y).
+//
+// The squares the new tiles would go on are fixed, so for each number of extra
+// tiles we know exactly how long the main word and the perpendicular words
+// through them would be (including Qwirkle bonuses).  The bound assumes each
+// square gets some tile which passes its cross-check, stopping at the first
+// square no rack tile can go on or where the main word would grow past 6.
+inline int scoreUpperBound(const BoardState& board,
+			   const Move& move,
+			   int num_tiles,
+			   TileSet rack_tiles,
+			   int x, int y,
+			   int dx, int dy) {
+  bool horiz = (dx != 0);
+  int main_len = board.wordLength(move.tiles[0].x, move.tiles[0].y, horiz);
+  int perpendicular_score = move.score - wordScore(main_len);
+  int bound = move.score;
+
+  for (int i = 0; i < num_tiles; i++) {
+    assert(board.isEmpty(x, y));
+    if (!board.canHold(x, y) || (board.legalTiles(x, y) & rack_tiles) == 0) {
+      break;
+    }
+
+    // Placing a tile here joins up with any tiles which follow:
+    int following = board.isEmpty(x + dx, y + dy) ? 0 :
+      board.wordLength(x + dx, y + dy, horiz);
+    main_len += 1 + following;
+    if (main_len > 6) {
+      break;
+    }
+
+    int cross_len = 1;
+    if (!board.isEmpty(x - dy, y - dx)) {
+      cross_len += board.wordLength(x - dy, y - dx, !horiz);
+    }
+    if (!board.isEmpty(x + dy, y + dx)) {
+      cross_len += board.wordLength(x + dy, y + dx, !horiz);
+    }
+    perpendicular_score += wordScore(cross_len);
+
+    bound = std::max(bound, wordScore(main_len) + perpendicular_score);
+
+    x += dx * (1 + following);
+    y += dy * (1 + following);
+  }
+  return bound;
+}
+
+// A time by which a search has to return.  The default deadline never passes,
+// which makes the search exhaustive.
+class Deadline {
+ public:
+  Deadline() : limited_(false), cancelled_(nullptr) {}
+
+  // A deadline ms milliseconds from now.
+  static Deadline after(int ms) {
+    Deadline deadline;
+    deadline.limited_ = true;
+    deadline.when_ = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(ms);
+    return deadline;
+  }
+
+  // A deadline which passes once another thread sets *cancelled.
+  static Deadline cancelledBy(const std::atomic<bool>* cancelled) {
+    Deadline deadline;
+    deadline.cancelled_ = cancelled;
+    return deadline;
+  }
+
+  bool isLimited() const { return limited_ || cancelled_ != nullptr; }
+
+  bool hasPassed() const {
+    return (cancelled_ != nullptr &&
+	    cancelled_->load(std::memory_order_relaxed)) ||
+      (limited_ && std::chrono::steady_clock::now() >= when_);
+  }
+
+ private:
+  bool limited_;
+  std::chrono::steady_clock::time_point when_;
+  const std::atomic<bool>* cancelled_;
+};
+
+// Lets searches running in parallel (one per anchor) prune with the best score
+// any of them has found so far.  Each search has its own SharedBound pointing
+// at the common score, which also records the highest upper bound of any
+// subtree the search skipped because of it (or -1 if none was).  If that isn't
+// below the score of the search's best move, the search may have missed a move
+// at least as good.
+//
+// The searches can also share a deadline.  Once it passes, stopped is set and
+// every search returns as soon as it notices, keeping the best move it has
+// found so far; interrupted records that this search was one of them.
+struct SharedBound {
+  explicit SharedBound(std::atomic<int>* best_score) :
+    best_score(best_score), deadline(nullptr), stopped(nullptr), max_cut(-1),
+    interrupted(false) {}
+
+  SharedBound(std::atomic<int>* best_score,
+	      const Deadline* deadline,
+	      std::atomic<bool>* stopped) :
+    best_score(best_score), deadline(deadline), stopped(stopped), max_cut(-1),
+    interrupted(false) {}
+
+  // Returns true if the search should stop.  Reading the clock costs about as
+  // much as a search node, so it is only read every 64 nodes.
+  bool timeUp() {
+    if (stopped == nullptr) {
+      return false;
+    }
+    if (!stopped->load(std::memory_order_relaxed)) {
+      if ((search_counters.nodes & 63) != 0 || !deadline->hasPassed()) {
+	return false;
+      }
+      stopped->store(true, std::memory_order_relaxed);
+    }
+    interrupted = true;
+    return true;
+  }
+
+  std::atomic<int>* best_score;
+  const Deadline* deadline;
+  std::atomic<bool>* stopped;
+  int max_cut;
+  bool interrupted;
+};
+
+// Raises *best_score to score if it is lower.
+inline void raiseBestScore(std::atomic<int>* best_score, int score) {
+  int current = best_score->load(std::memory_order_relaxed);
+  while (current < score &&
+	 !best_score->compare_exchange_weak(current, score,
+					    std::memory_order_relaxed)) {
+  }
+}
+
+// Returns true if the last tile of move (which is on the board, and was placed
+// moving in direction (dx,dy)) went on an anchor: a square next to a tile
+// which was already on the board before the move.
+inline bool endsOnAnchor(const BoardState& board,
+			 const Move& move,
+			 int dx, int dy) {
+  const Placement& last = move.tiles[move.num_tiles - 1];
+  if (!board.isEmpty(last.x + dx, last.y + dy) ||
+      !board.isEmpty(last.x - dy, last.y - dx) ||
+      !board.isEmpty(last.x + dy, last.y + dx)) {
+    return true;
+  }
+  // The square behind the last tile holds either the previous tile of the
+  // move, or a tile which was skipped over.
+  const Placement& previous = move.tiles[move.num_tiles - 2];
+  return (previous.x != last.x - dx || previous.y != last.y - dy);
+}
+
+// Returns true if this is the one place the search should evaluate move, a
+// move which has just been reached by extending in direction (dx,dy).  Every
+// move is reached more than once: a single tile from all four directions,
+// and a move whose first and last tiles are both on anchors both forwards from
+// the first and backwards from the last.  Only the first of these, in the
+// order the search runs, counts.
+inline bool isCanonical(const BoardState& board,
+			const Move& move,
+			int dx, int dy) {
+  if (move.num_tiles == 1) {
+    return dx == 1;
+  }
+  if (dx > 0 || dy > 0) {
+    return true;
+  }
+  return !endsOnAnchor(board, move, dx, dy);
+}
+
+// If we've started a move on the board, recursively evaluate all possible moves
+// in a given direction (up, down, left or right) using the tiles we have left
+// on our rack to find the best move.  The tiles of the move so far are already
+// on the board (and off the rack).  Further tiles are placed and taken back as
+// we go, so board, rack and move are unchanged on return.  best_move is
+// replaced whenever a higher scoring move is found.  Moves which the search
+// reaches more than once are only scored the first time (see isCanonical).
+//
+// This is a branch-and-bound search: subtrees whose upper bound can't beat
+// best_move are skipped.  shared, if not null, holds the best score found by
+// any search running in parallel with this one (raised when best_move
+// improves).  Subtrees which can't even equal it are skipped too.  Moves which
+// tie with the shared score are still found, so the result doesn't depend on
+// how parallel searches interleave.  If shared's deadline passes, the search
+// stops with the best move found so far.
+inline void bestMoveGivenPrefix(BoardState* board,
+				Rack* rack,
+				int x, int y,
+				Move* move,
+				int dx, int dy,
+				Move* best_move,
+				SharedBound* shared) {
+  assert((dx ==  1 && dy ==  0) ||
+	 (dx == -1 && dy ==  0) ||
+	 (dx ==  0 && dy ==  1) ||
+	 (dx ==  0 && dy == -1));
+
+  search_counters.nodes++;
+
+  move->horiz = (dx != 0);
+  move->score = scoreMove(*board, *move);
+  if (move->score > best_move->score && isCanonical(*board, *move, dx, dy)) {
+    *best_move = *move;
+    COUNT_SEARCH_STAT(moves_found);
+    if (shared != nullptr) {
+      raiseBestScore(shared->best_score, move->score);
+    }
+  }
+
+  if (shared != nullptr && shared->timeUp()) {
+    return;
+  }
+
+  while(!board->isEmpty(x, y)) {
+    x += dx;
+    y += dy;
+  }
+  if (!board->canHold(x, y)) {
+    return;
+  }
+
+  TileSet rack_tiles = rack->tileSet();
+  int bound = scoreUpperBound(*board, *move, rack->size(), rack_tiles,
+			      x, y, dx, dy);
+  if (bound <= best_move->score) {
+    return;
+  }
+  if (shared != nullptr &&
+      bound < shared->best_score->load(std::memory_order_relaxed)) {
+    shared->max_cut = std::max(shared->max_cut, bound);
+    return;
+  }
+
+  // Loop through all the kinds of tile on our rack which can go here and see if
+  // adding any improves our move.  (A second copy of a tile would only lead to
+  // the same moves again.)
+  TileSet candidates = board->legalTiles(x, y) & rack_tiles;
+  for (; candidates != 0; candidates &= candidates - 1) {
+    Tile tile = Tile::fromCode(firstTile(candidates));
+    rack->removeTile(tile);
+    board->insertTile(tile, x, y);
+    move->push(tile, x, y);
+    assert(board->isValidBoard());
+
+    // We found a move we can make!  Recurse to see if there are more tiles we
+    // can place.
+    bestMoveGivenPrefix(board, rack, x, y, move, dx, dy, best_move, shared);
+
+    move->pop();
+    board->removeTile(x, y);
+    rack->addTile(tile);
+  }
+}
+			 
+// The four directions a move's tiles can be placed in, in the order they are
+// searched.
+const int kMoveDirections[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+// An anchor is an empty square next to at least one tile: every move has to
+// start on one.  Alongside it we keep the cross-check for the square, the set
+// of tiles that can legally go there.
+struct Anchor {
+  Anchor(int x, int y, TileSet legal_tiles) :
+    x(x), y(y), legal_tiles(legal_tiles) {}
+
+  int x, y;
+  TileSet legal_tiles;
+};
+
+// Find every anchor on the board which at least one tile can be placed on (and
+// which the grid has room for).  Anchors are returned in the same order
+// computerTurn used to scan the board in, so ties between equally good moves
+// are broken the same way.
+inline std::vector<Anchor> findAnchors(const BoardState& board) {
+  std::vector<Anchor> anchors;
+  if (board.minX() == board.maxX()) {
+    // On an empty board the first move starts at the origin.
+    anchors.push_back(Anchor(0, 0, kAllTiles));
+    return anchors;
+  }
+  for (int x = board.minX()-1; x <= board.maxX(); x++) {
+    for (int y = board.minY()-1; y <= board.maxY(); y++) {
+      if (board.isAdjacent(x, y) && board.canHold(x, y)) {
+	TileSet legal_tiles = board.legalTiles(x, y);
+	if (legal_tiles != 0) {
+	  anchors.push_back(Anchor(x, y, legal_tiles));
+	}
+      }
+    }
+  }
+  return anchors;
+}
+
+// Given an anchor, find the best move possible that includes putting a tile
+// on it, and replace best_move with it if it scores higher.  The board and rack
+// are unchanged on return.  shared is as for bestMoveGivenPrefix.
+inline void bestMove(BoardState* board,
+		     Rack* rack,
+		     const Anchor& anchor,
+		     Move* best_move,
+		     SharedBound* shared) {
+  int x = anchor.x;
+  int y = anchor.y;
+
+  // Try every kind of tile on our rack in this location to see what we can
+  // do.  Tiles which fail the cross-check are pruned before touching the board.
+  TileSet candidates = anchor.legal_tiles & rack->tileSet();
+  for (; candidates != 0; candidates &= candidates - 1) {
+    Tile tile = Tile::fromCode(firstTile(candidates));
+    rack->removeTile(tile);
+    board->insertTile(tile, x, y);
+    assert(board->isValidBoard());
+
+    // We found a move we can make!  Now explore in all four directions (up,
+    // down, left and right) to find the highest scoring word we can build in
+    // that direction.
+    Move move;
+    move.push(tile, x, y);
+    bestMoveGivenPrefix(board, rack, x, y, &move,  1,  0, best_move, shared);
+    bestMoveGivenPrefix(board, rack, x, y, &move, -1,  0, best_move, shared);
+    bestMoveGivenPrefix(board, rack, x, y, &move,  0,  1, best_move, shared);
+    bestMoveGivenPrefix(board, rack, x, y, &move,  0, -1, best_move, shared);
+
+    board->removeTile(x, y);
+    rack->addTile(tile);
+  }
+}
+
+// Calls visit(move) for every move that extends move in direction (dx,dy)
+// (including move itself), as bestMoveGivenPrefix would score them, each only
+// once.  The board and rack are unchanged on return.
+template <typename Visit>
+inline void forEachMoveGivenPrefix(BoardState* board,
+				   Rack* rack,
+				   int x, int y,
+				   Move* move,
+				   int dx, int dy,
+				   Visit& visit) {
+  move->horiz = (dx != 0);
+  move->score = scoreMove(*board, *move);
+  if (isCanonical(*board, *move, dx, dy)) {
+    COUNT_SEARCH_STAT(moves_found);
+    visit(static_cast<const Move&>(*move));
+  }
+
+  while(!board->isEmpty(x, y)) {
+    x += dx;
+    y += dy;
+  }
+  if (!board->canHold(x, y)) {
+    return;
+  }
+
+  TileSet candidates = board->legalTiles(x, y) & rack->tileSet();
+  for (; candidates != 0; candidates &= candidates - 1) {
+    Tile tile = Tile::fromCode(firstTile(candidates));
+    rack->removeTile(tile);
+    board->insertTile(tile, x, y);
+    move->push(tile, x, y);
+
+    forEachMoveGivenPrefix(board, rack, x, y, move, dx, dy, visit);
+
+    move->pop();
+    board->removeTile(x, y);
+    rack->addTile(tile);
+  }
+}
+
+// Calls visit(move) with every move that rack can make on board, in anchor
+// order, as the moves are found.  Nothing is kept between calls, so this takes
+// the same memory however many moves there are.  The board and rack are
+// changed while visit runs (it mustn't change them itself), and are unchanged
+// on return.
+template <typename Visit>
+inline void forEachMove(BoardState* board, Rack* rack, Visit visit) {
+  std::vector<Anchor> anchors = findAnchors(*board);
+  for (auto anchor = anchors.begin(); anchor != anchors.end(); anchor++) {
+    TileSet candidates = anchor->legal_tiles & rack->tileSet();
+    for (; candidates != 0; candidates &= candidates - 1) {
+      Tile tile = Tile::fromCode(firstTile(candidates));
+      rack->removeTile(tile);
+      board->insertTile(tile, anchor->x, anchor->y);
+      for (int d = 0; d < 4; d++) {
+	Move move;
+	move.push(tile, anchor->x, anchor->y);
+	forEachMoveGivenPrefix(board, rack, anchor->x, anchor->y, &move,
+			       kMoveDirections[d][0], kMoveDirections[d][1],
+			       visit);
+      }
+      board->removeTile(anchor->x, anchor->y);
+      rack->addTile(tile);
+    }
+  }
+}
+
+// Replaces moves with every move that rack can make on board, in anchor order.
+// The board and rack are unchanged on return.
+inline void allMoves(BoardState* board,
+		     Rack* rack,
+		     std::vector<Move>* moves) {
+  moves->clear();
+  forEachMove(board, rack, [moves](const Move& move) {
+      moves->push_back(move);
+    });
+}
+
+// Keeps the n highest scoring of the moves given to add(), and of moves which
+// score the same the ones given first, so that its moves are the first n of
+// the moves sorted (stably) by score.  It holds no more than n moves at once.
+class TopMoves {
+ public:
+  explicit TopMoves(int n) { clear(n); }
+
+  // Forgets the moves so far, and keeps the n best from now on.
+  void clear(int n) {
+    n_ = std::max(0, n);
+    added_ = 0;
+    heap_.clear();
+  }
+
+  void add(const Move& move) {
+    Entry entry{move, added_++};
+    if (int(heap_.size()) < n_) {
+      heap_.push_back(entry);
+      std::push_heap(heap_.begin(), heap_.end(), better);
+    } else if (n_ > 0 && better(entry, heap_.front())) {
+      // Replace the worst move kept, which is at the top of the heap.
+      std::pop_heap(heap_.begin(), heap_.end(), better);
+      heap_.back() = entry;
+      std::push_heap(heap_.begin(), heap_.end(), better);
+    }
+  }
+
+  // Replaces moves with the moves kept, best first.
+  void sorted(std::vector<Move>* moves) const {
+    std::vector<Entry> entries = heap_;
+    std::sort(entries.begin(), entries.end(), better);
+    moves->clear();
+    for (auto e = entries.begin(); e != entries.end(); e++) {
+      moves->push_back(e->move);
+    }
+  }
+
+ private:
+  struct Entry {
+    Move move;
+    long order;  // Number of moves added before this one
+  };
+
+  static bool better(const Entry& a, const Entry& b) {
+    return a.move.score > b.move.score ||
+      (a.move.score == b.move.score && a.order < b.order);
+  }
+
+  int n_;
+  long added_;
+  std::vector<Entry> heap_;  // A heap with the worst move kept on top
+};
+
+// Returns the move findBestMove() would, searching on the calling thread
+// alone, in place on board and rack (which are unchanged on return) rather than
+// on copies of them.  For searches which run many small searches in parallel
+// themselves.
+inline Move greedyMove(BoardState* board, Rack* rack) {
+  Move best_move;
+  TileSet rack_tiles = rack->tileSet();
+  std::vector<Anchor> anchors = findAnchors(*board);
+  for (auto anchor = anchors.begin(); anchor != anchors.end(); anchor++) {
+    if ((anchor->legal_tiles & rack_tiles) != 0) {
+      bestMove(board, rack, *anchor, &best_move, nullptr);
+    }
+  }
+  return best_move;
+}
+
+// The best move at each anchor, kept from one search to the next.  Most of the
+// board is unchanged between one turn and the next, and an anchor's best move
+// only depends on the rack and on the squares in line with it, so most anchors
+// don't need to be searched again.  This pays off late in the game: while the
+// bag has tiles in it, each turn's rack has new tiles on it, which could make
+// new moves anywhere.
+//
+// The cache works out what has changed itself (by comparing against the board
+// and rack it last saw), so it stays correct whoever moved, human or computer.
+class MoveCache {
+ public:
+  // A move from an anchor covers squares in the anchor's row or column, and
+  // since words are at most 6 long, nothing further than this along them can
+  // join its main word.
+  static const int kReach = 6;
+
+  MoveCache() :
+    minx_(0), maxx_(0), miny_(0), maxy_(0),
+    rack_(nullptr, std::vector<Tile>()) {}
+
+  // Fills in what is cached about each anchor for a search of board with rack
+  // (see findBestMove() for the meaning of best_at_anchor, exact and upper).
+  // Entries which might have changed since the last search are dropped first.
+  void lookup(const BoardState& board,
+	      const Rack& rack,
+	      const std::vector<Anchor>& anchors,
+	      std::vector<Move>* best_at_anchor,
+	      std::vector<char>* exact,
+	      std::vector<int>* upper) {
+    if (gainedTiles(rack) || board.minX() == board.maxX() || minx_ == maxx_) {
+      // A new tile could make new moves anywhere, and the first move always
+      // starts at the origin.
+      entries_.clear();
+    }
+    if (!entries_.empty()) {
+      // Losing tiles only takes moves away, so a move which doesn't use a tile
+      // that has gone is still the best at its anchor (and bounds still hold).
+      TileSet rack_tiles = rack.tileSet();
+      std::vector<std::pair<int, int>> touched = touchedSquares(board);
+      entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+				    [&](const Entry& e) {
+				      return (e.tiles & ~rack_tiles) != 0 ||
+					inReach(e.x, e.y, touched);
+				    }),
+		     entries_.end());
+    }
+    saveBoard(board);
+    rack_ = rack;
+
+    // Entries and anchors are both in anchor order.
+    auto e = entries_.begin();
+    for (size_t i = 0; i < anchors.size() && e != entries_.end(); i++) {
+      while (e != entries_.end() && before(*e, anchors[i])) {
+	e++;
+      }
+      if (e != entries_.end() && e->x == anchors[i].x &&
+	  e->y == anchors[i].y) {
+	(*best_at_anchor)[i] = e->move;
+	(*exact)[i] = e->exact;
+	(*upper)[i] = e->upper;
+      }
+    }
+  }
+
+  // Replaces the cache's entries with what is known about each anchor, for the
+  // board and rack last passed to lookup().
+  void store(const std::vector<Anchor>& anchors,
+	     const std::vector<Move>& best_at_anchor,
+	     const std::vector<char>& exact,
+	     const std::vector<int>& upper) {
+    entries_.clear();
+    for (size_t i = 0; i < anchors.size(); i++) {
+      if (upper[i] >= 0) {
+	entries_.push_back(Entry(anchors[i].x, anchors[i].y, best_at_anchor[i],
+				 exact[i], upper[i]));
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    Entry(int x, int y, const Move& move, bool exact, int upper) :
+      x(x), y(y), move(move), exact(exact), upper(upper), tiles(0) {
+      for (int i = 0; i < move.num_tiles; i++) {
+	tiles |= tileBit(move.tiles[i].tile.code());
+      }
+    }
+
+    int x, y;
+    Move move;
+    bool exact;
+    int upper;
+    TileSet tiles;  // The tiles the move uses.
+  };
+
+  // Returns true if entry e's anchor comes before anchor a in anchor order.
+  static bool before(const Entry& e, const Anchor& a) {
+    return e.x < a.x || (e.x == a.x && e.y < a.y);
+  }
+
+  // Returns true if rack has a tile which the last rack didn't.
+  bool gainedTiles(const Rack& rack) const {
+    for (TileSet set = rack.tileSet(); set != 0; set &= set - 1) {
+      Tile tile = Tile::fromCode(firstTile(set));
+      if (rack.count(tile) > rack_.count(tile)) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  // Keeps a copy of the occupied part of board, to compare the next board
+  // against.  (A copy of the whole BoardState would cost more than the
+  // searches it saves.)
+  void saveBoard(const BoardState& board) {
+    minx_ = board.minX();
+    maxx_ = board.maxX();
+    miny_ = board.minY();
+    maxy_ = board.maxY();
+    squares_.resize((maxx_ - minx_) * (maxy_ - miny_));
+    board.getSquares(minx_, maxx_, miny_, maxy_, squares_.data());
+  }
+
+  // Returns the squares which a search might see differently on board than on
+  // the saved board: the squares whose contents differ, and the empty squares
+  // at either end of any word that runs through them.  The search only looks
+  // at squares in line with its anchor, and at the words crossing them, so an
+  // anchor which has none of these squares in reach can't have changed.
+  std::vector<std::pair<int, int>> touchedSquares(const BoardState& board) {
+    // Lay out the saved and the new board over the same rectangle.
+    int minx = std::min(board.minX(), minx_);
+    int maxx = std::max(board.maxX(), maxx_);
+    int miny = std::min(board.minY(), miny_);
+    int maxy = std::max(board.maxY(), maxy_);
+    int width = maxx - minx;
+    before_.assign(width * (maxy - miny), 0);
+    for (int y = miny_; y < maxy_; y++) {
+      std::copy(squares_.begin() + (y - miny_) * (maxx_ - minx_),
+		squares_.begin() + (y - miny_ + 1) * (maxx_ - minx_),
+		before_.begin() + (y - miny) * width + (minx_ - minx));
+    }
+    after_.resize(before_.size());
+    board.getSquares(minx, maxx, miny, maxy, after_.data());
+
+    // Is there a tile on (x,y) on either board?
+    auto occupied = [&](int x, int y) {
+      if (x < minx || x >= maxx || y < miny || y >= maxy) {
+	return false;
+      }
+      int i = (y - miny) * width + (x - minx);
+      return before_[i] != 0 || after_[i] != 0;
+    };
+
+    const int kDirections[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    std::vector<std::pair<int, int>> touched;
+    for (int y = miny; y < maxy; y++) {
+      int row = (y - miny) * width;
+      if (std::equal(before_.begin() + row, before_.begin() + row + width,
+		     after_.begin() + row)) {
+	continue;
+      }
+      for (int x = minx; x < maxx; x++) {
+	if (before_[row + x - minx] == after_[row + x - minx]) {
+	  continue;
+	}
+	touched.push_back(std::make_pair(x, y));
+	for (int d = 0; d < 4; d++) {
+	  int ix = x + kDirections[d][0];
+	  int iy = y + kDirections[d][1];
+	  while (occupied(ix, iy)) {
+	    ix += kDirections[d][0];
+	    iy += kDirections[d][1];
+	  }
+	  touched.push_back(std::make_pair(ix, iy));
+	}
+      }
+    }
+    return touched;
+  }
+
+  static bool inReach(int x, int y,
+		      const std::vector<std::pair<int, int>>& squares) {
+    for (auto s = squares.begin(); s != squares.end(); s++) {
+      if ((s->second == y && abs(s->first - x) <= kReach) ||
+	  (s->first == x && abs(s->second - y) <= kReach)) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  // The board and rack the entries are for.  The board is kept as the squares
+  // of its extents, as from BoardState::getSquares().
+  int minx_, maxx_, miny_, maxy_;
+  std::vector<uint8_t> squares_;
+  Rack rack_;
+
+  std::vector<Entry> entries_;  // In anchor order.
+
+  // Scratch space for touchedSquares().
+  std::vector<uint8_t> before_;
+  std::vector<uint8_t> after_;
+};
+
+// Returns the score of playing a single tile on the empty square (x,y).  The
+// search tries the most promising anchors first by this measure, so that good
+// moves are found early and prune more of the rest of the search.
+inline int singleTileScore(const BoardState& board, int x, int y) {
+  int score = 0;
+  for (int horiz = 0; horiz < 2; horiz++) {
+    int dx = horiz;
+    int dy = 1 - horiz;
+    int len = 1;
+    if (!board.isEmpty(x - dx, y - dy)) {
+      len += board.wordLength(x - dx, y - dy, horiz);
+    }
+    if (!board.isEmpty(x + dx, y + dy)) {
+      len += board.wordLength(x + dx, y + dy, horiz);
+    }
+    score += wordScore(len);
+  }
+  return score;
+}
+
+// Best moves are kept in a TranspositionTable packed into 64 bits:
+//
+//   bits  0-31  the codes of the tiles, in base 36, first tile lowest
+//   bits 32-34  the number of tiles
+//   bits 35-36  the direction the tiles were placed in, from kMoveDirections
+//   bits 37-45  x + 256 for the first tile
+//   bits 46-54  y + 256 for the first tile
+//   bits 55-63  the score
+//
+// A move's squares follow from its first square and direction, skipping over
+// tiles already on the board, as the search placed them.
+
+// Packs move into *data, returning false if it is too far from the origin.
+inline bool packMove(const Move& move, uint64_t* data) {
+  int x = (move.num_tiles > 0) ? move.tiles[0].x : 0;
+  int y = (move.num_tiles > 0) ? move.tiles[0].y : 0;
+  if (x < -256 || x >= 256 || y < -256 || y >= 256 || move.score >= 512) {
+    return false;
+  }
+  int direction = move.horiz ? 0 : 2;
+  if (move.num_tiles > 1 &&
+      (move.tiles[1].x < x || move.tiles[1].y < y)) {
+    direction++;
+  }
+  uint64_t codes = 0;
+  for (int i = move.num_tiles - 1; i >= 0; i--) {
+    codes = codes * 36 + move.tiles[i].tile.code();
+  }
+  *data = codes |
+    uint64_t(move.num_tiles) << 32 |
+    uint64_t(direction) << 35 |
+    uint64_t(x + 256) << 37 |
+    uint64_t(y + 256) << 46 |
+    uint64_t(move.score) << 55;
+  return true;
+}
+
+// Unpacks a move packed by packMove() for board and rack.  Returns false if it
+// can't be played there (which a table only returns if two positions' keys
+// collide).
+inline bool unpackMove(const BoardState& board, const Rack& rack,
+		       uint64_t data, Move* move) {
+  *move = Move();
+  int num_tiles = (data >> 32) & 7;
+  int direction = (data >> 35) & 3;
+  int dx = kMoveDirections[direction][0];
+  int dy = kMoveDirections[direction][1];
+  int x = int((data >> 37) & 511) - 256;
+  int y = int((data >> 46) & 511) - 256;
+  uint64_t codes = data & 0xffffffffULL;
+  if (num_tiles > Rack::kMaxTiles) {
+    return false;
+  }
+
+  uint8_t used[Tile::kNumCodes] = {};
+  for (int i = 0; i < num_tiles; i++) {
+    int code = codes % 36;
+    codes /= 36;
+    Tile tile = Tile::fromCode(code);
+    if (++used[code] > rack.count(tile)) {
+      return false;
+    }
+    while (!board.isEmpty(x, y)) {
+      x += dx;
+      y += dy;
+    }
+    move->push(tile, x, y);
+    x += dx;
+    y += dy;
+  }
+  move->horiz = (dx != 0);
+  move->score = int(data >> 55);
+  return true;
+}
+
+// Find the best move for the given rack.  The search is spread across the
+// pool's threads one anchor at a time; each worker searches on its own copy of
+// the board and rack.  Anchors are searched most promising first, but the best
+// move at each anchor is kept separately and the anchors compared in their
+// original order afterwards.  So the result is the same move an exhaustive
+// single-threaded search would find, whatever the number of threads.
+//
+// If cache is not null, anchors whose best move it holds aren't searched, and
+// the best moves found at other anchors are added to it.
+//
+// If table is not null, a position it holds the best move for isn't searched
+// again, and the best move is added to it once the search is done.  Tables may
+// be shared between searches running in parallel.
+//
+// If deadline passes before the search is done, the best move found so far is
+// returned instead, and *finished (if finished is not null) is set to false.
+// The most promising anchor is always searched at least as far as its one-tile
+// moves, so a move is found whenever one is possible.
+inline Move findBestMove(const BoardState& board,
+			 const Rack& rack,
+			 WorkStealingPool* pool,
+			 MoveCache* cache,
+			 TranspositionTable* table,
+			 const Deadline& deadline,
+			 bool* finished) {
+  uint64_t key = board.key() ^ rack.key();
+  uint64_t data;
+  Move best_move;
+  if (table != nullptr && table->probe(key, &data) &&
+      unpackMove(board, rack, data, &best_move)) {
+    if (finished != nullptr) {
+      *finished = true;
+    }
+    return best_move;
+  }
+
+  // Approach: exhaustive search.  Start at each anchor (an empty square next to
+  // a tile that at least one tile could legally be placed on).  For each
+  // anchor, try to place each tile in our rack that passes its cross-check.
+  // Then start searching in all four directions (horizontal and vertical) to
+  // see if any additional tiles can be placed.  Once either no placement is
+  // possible or the rack is exhausted, record the move required to get there.
+
+  TileSet rack_tiles = rack.tileSet();
+
+  std::vector<Anchor> anchors = findAnchors(board);
+  anchors.erase(std::remove_if(anchors.begin(), anchors.end(),
+			       [rack_tiles](const Anchor& a)
+			       {return (a.legal_tiles & rack_tiles) == 0;}),
+		anchors.end());
+
+  // For each anchor we end up with a move, and an upper bound on the score of
+  // any move there (-1 if nothing is known).  If exact is set the move is the
+  // best at the anchor; otherwise it is only known that the anchor can't have
+  // the best move overall.  Anchors which are known about from the cache, and
+  // anchors which turn out to be bounded below a move already found, aren't
+  // searched.
+  std::vector<Move> best_at_anchor(anchors.size());
+  std::vector<char> exact(anchors.size());
+  std::vector<int> upper(anchors.size(), -1);
+  if (cache != nullptr) {
+    cache->lookup(board, rack, anchors, &best_at_anchor, &exact, &upper);
+  }
+  std::atomic<int> best_score(0);
+  std::atomic<bool> stopped(false);
+  std::vector<std::pair<int, int>> order;  // (-priority, anchor index)
+  for (size_t i = 0; i < anchors.size(); i++) {
+    if (exact[i]) {
+      raiseBestScore(&best_score, best_at_anchor[i].score);
+    } else {
+      order.push_back(std::make_pair(-singleTileScore(board, anchors[i].x,
+						       anchors[i].y), i));
+    }
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<BoardState> boards(pool->numThreads(), board);
+  std::vector<Rack> racks(pool->numThreads(), rack);
+  pool->parallelFor(order.size(),
+		    [&](int worker, int i) {
+		      int anchor = order[i].second;
+		      if (upper[anchor] >= 0 &&
+			  upper[anchor] < best_score.load()) {
+			return;
+		      }
+		      if (i > 0 && stopped.load(std::memory_order_relaxed)) {
+			return;
+		      }
+		      SharedBound shared(&best_score, &deadline, &stopped);
+		      Move* best = &best_at_anchor[anchor];
+		      *best = Move();
+		      bestMove(&boards[worker], &racks[worker],
+			       anchors[anchor], best, &shared);
+		      if (shared.interrupted) {
+			// The move still counts, but nothing is known about
+			// the rest of the anchor.
+			exact[anchor] = false;
+			upper[anchor] = -1;
+		      } else {
+			exact[anchor] = (shared.max_cut < best->score);
+			upper[anchor] = std::max(best->score, shared.max_cut);
+		      }
+		    });
+  if (finished != nullptr) {
+    *finished = !stopped.load();
+  }
+  if (cache != nullptr) {
+    cache->store(anchors, best_at_anchor, exact, upper);
+  }
+
+  best_move = Move();
+  for (auto move = best_at_anchor.begin(); move != best_at_anchor.end();
+       move++) {
+    if (move->score > best_move.score) {
+      best_move = *move;
+    }
+  }
+  if (table != nullptr && !stopped.load() && packMove(best_move, &data)) {
+    table->store(key, data);
+  }
+  return best_move;
+}
+
+// The bonus for being the first to play every tile on your rack once the bag
+// is empty, which also ends the game.
+const int kGoOutBonus = 6;
+
+// Returns the tiles which the player holding rack can't see: those in the bag
+// and on the other player's rack.  Sorted by code.
+inline std::vector<Tile> unseenTiles(const BoardState& board,
+				     const Rack& rack) {
+  int unseen[Tile::kNumCodes];
+  std::fill(unseen, unseen + Tile::kNumCodes, Bag::kNumTiles / Tile::kNumCodes);
+  std::vector<uint8_t> squares((board.maxX() - board.minX()) *
+			       (board.maxY() - board.minY()));
+  board.getSquares(board.minX(), board.maxX(), board.minY(), board.maxY(),
+		   squares.data());
+  for (auto square = squares.begin(); square != squares.end(); square++) {
+    if (*square != 0) {
+      unseen[*square - 1]--;
+    }
+  }
+  std::vector<Tile> tiles;
+  for (int code = 0; code < Tile::kNumCodes; code++) {
+    unseen[code] -= rack.count(Tile::fromCode(code));
+    assert(unseen[code] >= 0);
+    tiles.insert(tiles.end(), unseen[code], Tile::fromCode(code));
+  }
+  return tiles;
+}
+
+// Searches the rest of the game once the bag is empty.  From then on each
+// player knows the other's rack (it's whatever tiles aren't on the board or on
+// their own rack), so the game can be searched like chess: negamax with
+// alpha-beta pruning, ordered by each move's own score, deepening one turn at a
+// time, with a transposition table to catch the same position reached by
+// playing moves in a different order.  The game ends when a player goes out
+// (scoring kGoOutBonus) or when both players pass in a row, which is what they
+// do when they have no move.
+//
+// Positions are valued as the points the player to move will score from now
+// on minus the points the other player will.  Beyond the depth searched a
+// position is valued at 0, so the result is only exact if the search reached
+// the end of every line of play.
+class EndgameSolver {
+ public:
+  // Turns (including passes) in the longest possible endgame: a player passing
+  // between each of the other's one-tile moves.
+  static const int kMaxDepth = 4 * Rack::kMaxTiles + 2;
+
+  // Enough to look a few turns ahead in most endgames while keeping each
+  // turn's search to a few tens of milliseconds.
+  static const long kDefaultNodeLimit = 2000;
+
+  // Each search gives up once it has searched node_limit positions (or its
+  // deadline has passed), keeping the result of the deepest search which
+  // finished.  table may be null, or shared with other searches.
+  EndgameSolver(TranspositionTable* table, long node_limit) :
+    table_(table), node_limit_(node_limit), nodes_(0), aborted_(false),
+    horizon_(false),
+    racks_{Rack(nullptr, std::vector<Tile>()),
+	   Rack(nullptr, std::vector<Tile>())},
+    moves_(kMaxDepth + 1) {}
+
+  // Finds the best move for rack on board, with the rest of the game to play
+  // and the other player holding every tile which is in neither.  Sets
+  // *best_move (a move with no tiles if rack can't move), *value to its value
+  // as above, and *exact to whether the whole game was searched.  Returns false
+  // if there are more of the other player's tiles than fit on a rack (i.e. the
+  // bag isn't empty), or if time ran out before even a one-turn search
+  // finished.
+  bool solve(const BoardState& board, const Rack& rack,
+	     const Deadline& deadline,
+	     Move* best_move, int* value, bool* exact) {
+    std::vector<Tile> other = unseenTiles(board, rack);
+    if (other.size() > size_t(Rack::kMaxTiles)) {
+      return false;
+    }
+
+    board_ = board;
+    racks_[0] = Rack(nullptr, rack.getTiles());
+    racks_[1] = Rack(nullptr, other);
+    deadline_ = deadline;
+    nodes_ = 0;
+    aborted_ = false;
+    *exact = false;
+    bool found = false;
+    for (int depth = 1; depth <= kMaxDepth; depth++) {
+      horizon_ = false;
+      int result = negamax(0, 0, depth, -kInfinity, kInfinity, 0);
+      if (aborted_) {
+	break;
+      }
+      found = true;
+      *best_move = root_move_;
+      *value = result;
+      if (!horizon_) {
+	*exact = true;
+	break;
+      }
+    }
+    return found;
+  }
+
+  // Positions searched by the last call to solve().
+  long nodes() const { return nodes_; }
+
+ private:
+  static const int kInfinity = 1000000;
+
+  // Table entries pack a value (offset to be positive) in bits 0-23, the kind
+  // of bound it is in bits 24-25, the depth searched in bits 26-31 (kSolved if
+  // the search reached the end of the game everywhere), and one more than the
+  // number of the best move, in the order allMoves() produces them, in bits
+  // 32-47 (0 if there was none).
+  enum Bound { kExact, kLower, kUpper };
+  static const int kSolved = 63;
+
+  static uint64_t packEntry(int value, Bound bound, int depth, int best) {
+    return uint64_t(value + (1 << 23)) |
+      uint64_t(bound) << 24 |
+      uint64_t(depth) << 26 |
+      uint64_t(best + 1) << 32;
+  }
+
+  // The key of the position with side to move, after passes passes in a row.
+  // The other rack's key (and the passes) are mixed again, so that swapping
+  // the racks gives a different key, and so that the keys don't line up with
+  // findBestMove()'s (board and rack only) in a shared table.
+  uint64_t positionKey(int side, int passes) const {
+    return board_.key() ^ racks_[side].key() ^
+      mixBits(racks_[1 - side].key() ^ (passes ? 0x5a5a : 0xa5a5));
+  }
+
+  // Returns true if the search has to stop.  Only reads the clock every 256
+  // positions.
+  bool outOfTime() {
+    if (!aborted_ &&
+	(nodes_ >= node_limit_ ||
+	 ((nodes_ & 255) == 0 && deadline_.hasPassed()))) {
+      aborted_ = true;
+    }
+    return aborted_;
+  }
+
+  // Returns the value of the position with side to move, searching depth
+  // turns ahead, where passes is the number of passes in a row which led to
+  // it.  Values outside (alpha, beta) are only bounds: a value <= alpha means
+  // the true value is at most that, one >= beta that it is at least that.  ply
+  // is the number of turns since the root, whose best move goes in root_move_.
+  int negamax(int side, int passes, int depth, int alpha, int beta, int ply) {
+    if (outOfTime()) {
+      return 0;
+    }
+    nodes_++;
+    search_counters.nodes++;
+    if (depth == 0) {
+      horizon_ = true;
+      return 0;
+    }
+
+    // A position already searched as deeply needn't be searched again (except
+    // at the root, which needs its best move).  Otherwise the last search's
+    // best move is the best guess.
+    uint64_t key = positionKey(side, passes);
+    uint64_t data;
+    int tt_best = -1;
+    if (table_ != nullptr && table_->probe(key, &data)) {
+      int value = int(data & 0xffffff) - (1 << 23);
+      Bound bound = Bound((data >> 24) & 3);
+      int entry_depth = (data >> 26) & 63;
+      tt_best = int((data >> 32) & 0xffff) - 1;
+      if (ply > 0 && entry_depth >= depth &&
+	  (bound == kExact ||
+	   (bound == kLower && value >= beta) ||
+	   (bound == kUpper && value <= alpha))) {
+	if (entry_depth != kSolved) {
+	  horizon_ = true;
+	}
+	return value;
+      }
+    }
+
+    Rack* rack = &racks_[side];
+    std::vector<Move>& moves = moves_[ply];
+    allMoves(&board_, rack, &moves);
+    if (moves.empty()) {
+      if (passes > 0) {
+	return 0;  // Neither player can move: the game is over.
+      }
+      if (ply == 0) {
+	root_move_ = Move();
+      }
+      return -negamax(1 - side, passes + 1, depth - 1, -beta, -alpha, ply + 1);
+    }
+
+    // Try the moves which score the most first (counting the bonus for going
+    // out), and before them the best move the last search of this position
+    // found.
+    std::vector<std::pair<int, int>> order;  // (-priority, move index)
+    for (size_t i = 0; i < moves.size(); i++) {
+      int priority = moves[i].score;
+      if (moves[i].num_tiles == int(rack->size())) {
+	priority += kGoOutBonus;
+      }
+      if (int(i) == tt_best) {
+	priority = kInfinity;
+      }
+      order.push_back(std::make_pair(-priority, i));
+    }
+    std::sort(order.begin(), order.end());
+
+    bool outer_horizon = horizon_;
+    horizon_ = false;
+    int original_alpha = alpha;
+    int best_value = -kInfinity;
+    int best = -1;
+    for (auto o = order.begin(); o != order.end(); o++) {
+      const Move& move = moves[o->second];
+      int value;
+      if (move.num_tiles == int(rack->size())) {
+	value = move.score + kGoOutBonus;
+      } else if (depth == 1) {
+	value = move.score;  // And the rest is beyond the search.
+	horizon_ = true;
+      } else {
+	for (int i = 0; i < move.num_tiles; i++) {
+	  board_.insertTile(move.tiles[i].tile,
+			    move.tiles[i].x, move.tiles[i].y);
+	  rack->removeTile(move.tiles[i].tile);
+	}
+	// Once there is a best move, first check whether each later move beats
+	// it (a cheaper search, with a window of one point), and only find out
+	// by how much if it does.
+	if (best >= 0) {
+	  value = move.score - negamax(1 - side, 0, depth - 1,
+				       move.score - alpha - 1,
+				       move.score - alpha, ply + 1);
+	}
+	if (best < 0 || (value > alpha && value < beta)) {
+	  value = move.score - negamax(1 - side, 0, depth - 1,
+				       move.score - beta,
+				       move.score - alpha, ply + 1);
+	}
+	for (int i = 0; i < move.num_tiles; i++) {
+	  board_.removeTile(move.tiles[i].x, move.tiles[i].y);
+	  rack->addTile(move.tiles[i].tile);
+	}
+	if (aborted_) {
+	  return 0;
+	}
+      }
+
+      if (value > best_value) {
+	best_value = value;
+	best = o->second;
+	if (ply == 0) {
+	  root_move_ = move;
+	}
+      }
+      alpha = std::max(alpha, value);
+      if (alpha >= beta) {
+	break;
+      }
+    }
+
+    bool solved = !horizon_;
+    horizon_ = outer_horizon || horizon_;
+    if (table_ != nullptr) {
+      Bound bound = (best_value <= original_alpha) ? kUpper :
+	(best_value >= beta) ? kLower : kExact;
+      table_->store(key, packEntry(best_value, bound,
+				   solved ? kSolved : depth, best));
+    }
+    return best_value;
+  }
+
+  TranspositionTable* table_;
+  long node_limit_;
+  Deadline deadline_;
+  long nodes_;
+  bool aborted_;
+  bool horizon_;  // Whether the search so far stopped short of a game's end.
+
+  // The position being searched: racks_[0] is the rack solve() was given.
+  BoardState board_;
+  Rack racks_[2];
+
+  std::vector<std::vector<Move>> moves_;  // The moves at each ply
+  Move root_move_;
+};
+
+#endif // SEARCH_H
@@ -0,0 +1,182 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "bag.h"
+#include "boardstate.h"
+#include "little_endian.h"
+#include "mapped_file.h"
+#include "rack.h"
+#include "zobrist.h"
+
+// A snapshot of a game in progress: the board, both racks, the bag (including
+// its random number generator, so the game goes on to draw the same tiles)
+// and the scores.  A snapshot file has a fixed layout, and is loaded by
+// mapping it into memory, checking its checksum, and copying each part
+// straight into place, so it loads in about the time it takes to read and
+// copy the board.
+//
+//   0   4 bytes   kSnapshotMagic
+//   4   4 bytes   kSnapshotVersion
+//   8   4 x 2     each player's score (signed)
+//   16  8 bytes   snapshotChecksum() of everything after the header
+//   24            the board, then each player's rack, then the bag, each as
+//                 its saveSnapshot() writes it
+//
+// Numbers are little-endian (see little_endian.h).  In the interactive game
+// player 0 is the user, and a snapshot is saved when it's their turn.
+//
+// The checksum catches a damaged file, but not one which some other program
+// wrote with a valid checksum and a board that doesn't hold together.  Those
+// are loaded with verify, which checks the board square by square instead.
+// Version 1 snapshots had no checksum, and are always verified.
+
+const uint32_t kSnapshotMagic = 0x534b5751;  // "QWKS"
+const int kSnapshotVersion = 2;
+const int kSnapshotHeaderSize = 24;
+const int kSnapshotSize = kSnapshotHeaderSize + BoardState::kSnapshotSize +
+  2 * Rack::kSnapshotSize + Bag::kSnapshotSize;
+
+// A 64-bit checksum of size bytes, taken 8 at a time.  Multiplying by an odd
+// number loses no bits, so any one changed word changes the result.
+inline uint64_t snapshotChecksum(const uint8_t* data, size_t size) {
+  uint64_t sum = 0;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    sum = (sum ^ loadLE64(data + i)) * 0x100000001b3ULL;
+  }
+  for (; i < size; i++) {
+    sum = (sum ^ data[i]) * 0x100000001b3ULL;
+  }
+  return mixBits(sum ^ size);
+}
+
+// Writes a snapshot to path, replacing whatever was there.  Returns false if
+// it couldn't be written.
+inline bool saveSnapshot(const std::string& path,
+			 const BoardState& board,
+			 const Rack& rack0,
+			 const Rack& rack1,
+			 const Bag& bag,
+			 int score0,
+			 int score1) {
+  std::vector<uint8_t> data(kSnapshotSize, 0);
+  uint8_t* out = data.data();
+  storeLE(out, kSnapshotMagic, 4);
+  storeLE(out + 4, kSnapshotVersion, 4);
+  storeLE(out + 8, uint32_t(score0), 4);
+  storeLE(out + 12, uint32_t(score1), 4);
+  out += kSnapshotHeaderSize;
+  board.saveSnapshot(out);
+  out += BoardState::kSnapshotSize;
+  rack0.saveSnapshot(out);
+  out += Rack::kSnapshotSize;
+  rack1.saveSnapshot(out);
+  out += Rack::kSnapshotSize;
+  bag.saveSnapshot(out);
+  storeLE(data.data() + 16,
+	  snapshotChecksum(data.data() + kSnapshotHeaderSize,
+			   kSnapshotSize - kSnapshotHeaderSize), 8);
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 && ok;
+}
+
+// Returns true if the tiles on board, on the racks and in bag are exactly the
+// game's tiles, each kind as many times as a new bag holds it.  While the bag
+// has tiles the racks are refilled from it after every turn, so they must
+// then both be full.
+inline bool tilesAddUp(const BoardState& board,
+		       const Rack& rack0,
+		       const Rack& rack1,
+		       const Bag& bag) {
+  int counts[Tile::kNumCodes] = {0};
+  std::vector<uint8_t> squares((board.maxX() - board.minX()) *
+			       (board.maxY() - board.minY()));
+  board.getSquares(board.minX(), board.maxX(), board.minY(), board.maxY(),
+		   squares.data());
+  for (auto square = squares.begin(); square != squares.end(); square++) {
+    if (*square != 0) {
+      counts[*square - 1]++;
+    }
+  }
+  std::vector<Tile> held[3] = {rack0.getTiles(), rack1.getTiles(),
+			       bag.getTiles()};
+  for (int i = 0; i < 3; i++) {
+    for (auto tile = held[i].begin(); tile != held[i].end(); tile++) {
+      counts[tile->code()]++;
+    }
+  }
+  for (int code = 0; code < Tile::kNumCodes; code++) {
+    if (counts[code] != Bag::kNumTiles / Tile::kNumCodes) {
+      return false;
+    }
+  }
+  return bag.tiles_left() == 0 ||
+    (held[0].size() == size_t(Rack::kMaxTiles) &&
+     held[1].size() == size_t(Rack::kMaxTiles));
+}
+
+// Loads the snapshot at path into the given game objects.  The racks keep
+// their bags.  Returns false, changing nothing, if the file can't be read or
+// isn't a valid snapshot.  verify checks the board square by square, for files
+// which saveSnapshot() may not have written (see above).
+inline bool loadSnapshot(const std::string& path,
+			 BoardState* board,
+			 Rack* rack0,
+			 Rack* rack1,
+			 Bag* bag,
+			 int* score0,
+			 int* score1,
+			 bool verify) {
+  MappedFile file(path);
+  if (!file.ok() || file.size() != size_t(kSnapshotSize)) {
+    return false;
+  }
+  const uint8_t* in = file.data();
+  uint64_t version = loadLE(in + 4, 4);
+  if (loadLE(in, 4) != kSnapshotMagic ||
+      (version != 1 && version != uint64_t(kSnapshotVersion))) {
+    return false;
+  }
+  if (version == 1) {
+    verify = true;
+  } else if (loadLE(in + 16, 8) !=
+	     snapshotChecksum(in + kSnapshotHeaderSize,
+			      kSnapshotSize - kSnapshotHeaderSize)) {
+    return false;
+  }
+
+  // Everything is loaded into copies first, so that the tiles can be counted
+  // across all of them before anything changes.
+  const uint8_t* board_in = in + kSnapshotHeaderSize;
+  const uint8_t* racks_in = board_in + BoardState::kSnapshotSize;
+  Rack new_rack0 = *rack0;
+  Rack new_rack1 = *rack1;
+  Bag new_bag = *bag;
+  BoardState new_board;
+  if (!new_rack0.loadSnapshot(racks_in) ||
+      !new_rack1.loadSnapshot(racks_in + Rack::kSnapshotSize) ||
+      !new_bag.loadSnapshot(racks_in + 2 * Rack::kSnapshotSize) ||
+      !new_board.loadSnapshot(board_in, verify) ||
+      !tilesAddUp(new_board, new_rack0, new_rack1, new_bag)) {
+    return false;
+  }
+  *board = new_board;
+  *rack0 = new_rack0;
+  *rack1 = new_rack1;
+  *bag = new_bag;
+  *score0 = int32_t(loadLE(in + 8, 4));
+  *score1 = int32_t(loadLE(in + 12, 4));
+  return true;
+}
+
+#endif // SNAPSHOT_H
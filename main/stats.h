@@ -0,0 +1,144 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <ostream>
+
+// Counts of the work done by the search on the current thread.  Used by
+// qwirkle_bench to report work per operation alongside the time it took, and
+// by --stats to report what each computer turn cost.
+//
+// Counting is a plain increment of a thread-local, but it can be compiled out
+// entirely with -DNO_SEARCH_STATS.  Nodes are always counted, since searches
+// use them to decide how often to check the clock.  Work done on a
+// WorkStealingPool's threads is added to the counts of the thread which ran
+// the loop (see thread_pool.h), so a turn's counts can be read from the thread
+// which played it.
+struct SearchCounters {
+  SearchCounters() :
+    nodes(0), board_copies(0), validations(0), scored_moves(0),
+    moves_found(0) {}
+
+  long nodes;         // Positions searched, by bestMoveGivenPrefix() or an
+		      // EndgameSolver
+  long board_copies;  // Copies made of a BoardState
+  long validations;   // Calls to BoardState::isValidBoard()
+  long scored_moves;  // Calls to scoreMove()
+  long moves_found;   // Moves which became the best so far, or were listed
+		      // by allMoves()
+
+  SearchCounters& operator+=(const SearchCounters& other) {
+    nodes += other.nodes;
+    board_copies += other.board_copies;
+    validations += other.validations;
+    scored_moves += other.scored_moves;
+    moves_found += other.moves_found;
+    return *this;
+  }
+
+  SearchCounters operator-(const SearchCounters& other) const {
+    SearchCounters result = *this;
+    result.nodes -= other.nodes;
+    result.board_copies -= other.board_copies;
+    result.validations -= other.validations;
+    result.scored_moves -= other.scored_moves;
+    result.moves_found -= other.moves_found;
+    return result;
+  }
+};
+
+inline thread_local SearchCounters search_counters;
+
+#ifdef NO_SEARCH_STATS
+const bool kSearchStats = false;
+#define COUNT_SEARCH_STAT(counter) ((void)0)
+#else
+const bool kSearchStats = true;
+#define COUNT_SEARCH_STAT(counter) (search_counters.counter++)
+#endif
+
+// A member which counts copies made of the object holding it, so that the
+// object can keep its implicit copy constructor and assignment.
+struct BoardCopyCounter {
+  BoardCopyCounter() {}
+#ifndef NO_SEARCH_STATS
+  BoardCopyCounter(const BoardCopyCounter&) {
+    COUNT_SEARCH_STAT(board_copies);
+  }
+  BoardCopyCounter& operator=(const BoardCopyCounter&) {
+    COUNT_SEARCH_STAT(board_copies);
+    return *this;
+  }
+#endif
+};
+
+// Measures the work done by the calling thread, and the time taken, since it
+// was constructed.
+class StatsTimer {
+ public:
+  StatsTimer() :
+    start_counters_(search_counters),
+    start_(std::chrono::steady_clock::now()) {}
+
+  SearchCounters counters() const { return search_counters - start_counters_; }
+
+  double seconds() const {
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_;
+    return elapsed.count();
+  }
+
+ private:
+  SearchCounters start_counters_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Prints counters for a person, e.g. "1234 nodes, 3 board copies, ...".
+inline void printCounters(std::ostream& out, const SearchCounters& counters) {
+  out << counters.nodes << " nodes, "
+      << counters.board_copies << " board copies, "
+      << counters.validations << " validations, "
+      << counters.scored_moves << " moves scored, "
+      << counters.moves_found << " moves found";
+}
+
+// Prints counters as the fields of a JSON object (without the braces), so
+// that callers can add fields of their own.
+inline void printCountersJson(std::ostream& out,
+			      const SearchCounters& counters) {
+  out << "\"nodes\":" << counters.nodes
+      << ",\"board_copies\":" << counters.board_copies
+      << ",\"validations\":" << counters.validations
+      << ",\"scored_moves\":" << counters.scored_moves
+      << ",\"moves_found\":" << counters.moves_found;
+}
+
+// What one computer turn cost, and the size of the board it was played on,
+// for --stats.
+struct TurnStats {
+  TurnStats() : board_tiles(0), board_width(0), board_height(0), seconds(0) {}
+
+  int board_tiles;
+  int board_width;
+  int board_height;
+  SearchCounters counters;
+  double seconds;
+
+  // Prints the stats for a person, on one line.
+  void print(std::ostream& out) const {
+    printCounters(out, counters);
+    out << " in " << 1e3 * seconds << " ms (board " << board_tiles
+	<< " tiles, " << board_width << "x" << board_height << ")";
+  }
+
+  // Prints the stats as the fields of a JSON object, like printCountersJson.
+  void printJson(std::ostream& out) const {
+    out << "\"board_tiles\":" << board_tiles
+	<< ",\"board_width\":" << board_width
+	<< ",\"board_height\":" << board_height << ",";
+    printCountersJson(out, counters);
+    out << ",\"us\":" << long(1e6 * seconds);
+  }
+};
+
+#endif // STATS_H
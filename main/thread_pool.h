@@ -0,0 +1,171 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "stats.h"
+
+// A fixed set of worker threads for running parallel loops.
+//
+// Each worker starts a loop with a contiguous share of its iterations in its
+// own queue.  Once a worker has run out of work it steals iterations from the
+// back of another worker's queue.  This keeps every thread busy even when some
+// iterations (say, anchors with deep subtrees in the move search) take far
+// longer than others.
+//
+// The search counters of the workers (see stats.h) are added to those of the
+// thread which called parallelFor when the loop finishes.
+class WorkStealingPool {
+ public:
+  // The calling thread acts as worker 0, so a pool of one thread doesn't start
+  // any threads at all.
+  explicit WorkStealingPool(int num_threads) :
+    job_(nullptr), generation_(0), busy_(0), shutdown_(false) {
+    assert(num_threads >= 1);
+    for (int i = 0; i < num_threads; i++) {
+      queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (int i = 1; i < num_threads; i++) {
+      threads_.push_back(std::thread([this, i](){ workerLoop(i); }));
+    }
+  }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      shutdown_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto t = threads_.begin(); t != threads_.end(); t++) {
+      t->join();
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  int numThreads() const { return queues_.size(); }
+
+  // Calls fn(worker, i) for every i in [0, n), where worker is the number (in
+  // [0, numThreads())) of the worker making the call.  Returns once every call
+  // has finished.  Calls are made in no particular order; callers which need a
+  // deterministic result should store results by i and combine them
+  // afterwards.
+  void parallelFor(int n, const std::function<void(int, int)>& fn) {
+    if (threads_.empty()) {
+      for (int i = 0; i < n; i++) {
+	fn(0, i);
+      }
+      return;
+    }
+
+    int num_workers = numThreads();
+    for (int w = 0; w < num_workers; w++) {
+      std::lock_guard<std::mutex> lock(queues_[w]->mu);
+      for (int i = n * w / num_workers; i < n * (w + 1) / num_workers; i++) {
+	queues_[w]->items.push_back(i);
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      job_ = &fn;
+      generation_++;
+      busy_ = threads_.size();
+    }
+    start_cv_.notify_all();
+
+    runJob(0);
+
+    std::unique_lock<std::mutex> lock(mu_);
+    done_cv_.wait(lock, [this](){ return busy_ == 0; });
+    job_ = nullptr;
+    search_counters += job_counters_;
+    job_counters_ = SearchCounters();
+  }
+
+ private:
+  struct Queue {
+    std::mutex mu;
+    std::deque<int> items;
+  };
+
+  void workerLoop(int worker) {
+    unsigned long seen_generation = 0;
+    while (true) {
+      {
+	std::unique_lock<std::mutex> lock(mu_);
+	start_cv_.wait(lock, [this, seen_generation](){
+	    return shutdown_ || generation_ != seen_generation;
+	  });
+	if (shutdown_) {
+	  return;
+	}
+	seen_generation = generation_;
+      }
+
+      SearchCounters start_counters = search_counters;
+      runJob(worker);
+
+      std::lock_guard<std::mutex> lock(mu_);
+      job_counters_ += search_counters - start_counters;
+      if (--busy_ == 0) {
+	done_cv_.notify_one();
+      }
+    }
+  }
+
+  void runJob(int worker) {
+    int i;
+    while (takeOwn(worker, &i) || steal(worker, &i)) {
+      (*job_)(worker, i);
+    }
+  }
+
+  bool takeOwn(int worker, int* i) {
+    Queue* q = queues_[worker].get();
+    std::lock_guard<std::mutex> lock(q->mu);
+    if (q->items.empty()) {
+      return false;
+    }
+    *i = q->items.front();
+    q->items.pop_front();
+    return true;
+  }
+
+  bool steal(int worker, int* i) {
+    int num_workers = numThreads();
+    for (int w = 1; w < num_workers; w++) {
+      Queue* q = queues_[(worker + w) % num_workers].get();
+      std::lock_guard<std::mutex> lock(q->mu);
+      if (!q->items.empty()) {
+	*i = q->items.back();
+	q->items.pop_back();
+	return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  // Protects everything below.
+  std::mutex mu_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(int, int)>* job_;
+  unsigned long generation_;
+  int busy_;  // Number of threads still working on the current job.
+  SearchCounters job_counters_;  // Work done by the threads on the current job
+  bool shutdown_;
+};
+
+#endif // THREAD_POOL_H
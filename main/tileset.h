@@ -0,0 +1,80 @@
+#ifndef TILESET_H
+#define TILESET_H
+
+#include <stdint.h>
+
+// A set of tiles, as a bitmask with one bit for each of the 36 distinct tiles,
+// indexed by tile code (color * 6 + shape, see Tile::code()).  Sets of tiles
+// are what the move search works with, so checking and combining them is a
+// few bitwise operations rather than a loop over tiles.
+typedef uint64_t TileSet;
+
+const TileSet kAllTiles = (TileSet(1) << 36) - 1;
+
+constexpr TileSet tileBit(int code) {
+  return TileSet(1) << code;
+}
+
+// Returns the lowest code in a non-empty set.  Loops over a set's tiles go
+//   for (TileSet s = set; s != 0; s &= s - 1) { int code = firstTile(s); ... }
+inline int firstTile(TileSet set) {
+  return __builtin_ctzll(set);
+}
+
+// All six shapes of one color.
+constexpr TileSet colorSet(int color) {
+  return TileSet(0x3f) << (6 * color);
+}
+
+// All six colors of one shape.
+constexpr TileSet shapeSet(int shape) {
+  return TileSet(0x41041041) << shape;
+}
+
+// For each tile, the tiles which share its color or its shape: the tiles which
+// may appear in the same word as it.
+struct LineMatesTable {
+  constexpr LineMatesTable() : mates() {
+    for (int code = 0; code < 36; code++) {
+      mates[code] = colorSet(code / 6) | shapeSet(code % 6);
+    }
+  }
+
+  TileSet mates[36];
+};
+
+constexpr LineMatesTable kLineMates;
+
+// The tiles of a word, added one at a time.  A word is valid if no tile
+// repeats and every pair of tiles shares a color or a shape (which can only
+// happen if they all share the same color or all the same shape).  So the
+// intersection of the tiles' line mates is all we need to keep to check a word,
+// or to find which tiles could join it.
+class WordTiles {
+ public:
+  WordTiles() : tiles_(0), mates_(kAllTiles), repeated_(false) {}
+
+  void add(int code) {
+    TileSet bit = tileBit(code);
+    repeated_ = repeated_ || (tiles_ & bit);
+    tiles_ |= bit;
+    mates_ &= kLineMates.mates[code];
+  }
+
+  bool isValid() const {
+    return !repeated_ && (tiles_ & ~mates_) == 0;
+  }
+
+  // Returns the tiles which could be added to the word leaving it valid.  Any
+  // tile can start an empty word.
+  TileSet compatible() const {
+    return isValid() ? (mates_ & ~tiles_) : 0;
+  }
+
+ private:
+  TileSet tiles_;
+  TileSet mates_;  // Tiles sharing a color or shape with every tile so far.
+  bool repeated_;
+};
+
+#endif // TILESET_H
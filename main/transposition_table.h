@@ -0,0 +1,67 @@
+#ifndef TRANSPOSITION_TABLE_H
+#define TRANSPOSITION_TABLE_H
+
+#include <assert.h>
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+// A fixed-size table of search results, keyed by 64-bit position keys (see
+// zobrist.h), which any number of threads can read and write at once without
+// locks.
+//
+// Each slot holds the key XORed with the data alongside the data itself.  A
+// reader checks that the two agree with the key it is after, so a slot which
+// another thread was halfway through writing (or which holds some other
+// position) reads as a miss rather than as wrong data.  A newer result always
+// replaces whatever was in its slot.
+class TranspositionTable {
+ public:
+  // The table has 2^log2_size slots.
+  explicit TranspositionTable(int log2_size) :
+    mask_((uint64_t(1) << log2_size) - 1), slots_(size_t(1) << log2_size) {
+    assert(log2_size > 0 && log2_size < 40);
+  }
+
+  TranspositionTable(const TranspositionTable&) = delete;
+  TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+  // Sets *data and returns true if the table holds data for key.
+  bool probe(uint64_t key, uint64_t* data) const {
+    const Slot& slot = slots_[key & mask_];
+    uint64_t check = slot.check.load(std::memory_order_relaxed);
+    uint64_t value = slot.data.load(std::memory_order_relaxed);
+    if ((check ^ value) != key) {
+      return false;
+    }
+    *data = value;
+    return true;
+  }
+
+  void store(uint64_t key, uint64_t data) {
+    Slot& slot = slots_[key & mask_];
+    slot.check.store(key ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+  }
+
+  // Empties the table.  Not safe to call while other threads use it.
+  void clear() {
+    for (auto slot = slots_.begin(); slot != slots_.end(); slot++) {
+      slot->check.store(0, std::memory_order_relaxed);
+      slot->data.store(0, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  struct Slot {
+    Slot() : check(0), data(0) {}
+
+    std::atomic<uint64_t> check;  // The key XOR data
+    std::atomic<uint64_t> data;
+  };
+
+  uint64_t mask_;
+  std::vector<Slot> slots_;
+};
+
+#endif // TRANSPOSITION_TABLE_H
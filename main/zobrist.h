@@ -0,0 +1,37 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include <stdint.h>
+
+// Zobrist keys: a position's key is the XOR of a random-looking 64-bit key for
+// each thing in it (a tile on a square, a copy of a tile on a rack), so it can
+// be updated in constant time as tiles come and go, and equal positions get
+// equal keys however they were reached.
+//
+// Board coordinates aren't bounded, so rather than a table of random numbers
+// each key is a mix of what it stands for.
+
+// The splitmix64 finalizer (as used to seed Random): a bijection on 64-bit
+// values which spreads every input bit across the output.
+inline uint64_t mixBits(uint64_t z) {
+  z += 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// The key for the tile with the given code on square (x,y).  The key depends
+// on board coordinates, not on where the board keeps the tile in memory, so it
+// doesn't change when the board moves its tiles around.
+inline uint64_t squareKey(int x, int y, int code) {
+  return mixBits((uint64_t(uint16_t(x)) << 32) |
+		 (uint64_t(uint16_t(y)) << 16) | uint64_t(code));
+}
+
+// The key for the n'th copy (counting from 1) of the tile with the given code
+// on a rack.  These never equal a square's key.
+inline uint64_t rackTileKey(int code, int n) {
+  return mixBits((uint64_t(1) << 63) | (uint64_t(code) << 8) | uint64_t(n));
+}
+
+#endif // ZOBRIST_H